@@ -0,0 +1,15 @@
+/* Child process for pt-write-ro.
+   Writes to its own code page, which is already mapped because
+   it is running.  The process must be terminated with -1 exit
+   code rather than fault forever. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  volatile int *code = (volatile int *) test_main;
+  *code = *code;
+  fail ("child can modify its own code segment");
+}
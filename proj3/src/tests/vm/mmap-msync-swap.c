@@ -0,0 +1,58 @@
+/* Maps a file and writes to several adjacent pages of it, then
+   writes a buffer larger than physical memory, so that the
+   mapped pages are evicted, either to the file or to swap.
+   Verifies with the read system call that msync, and then
+   munmap, leave the written data in the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_CNT 8
+#define SIZE (PAGE_CNT * 4096)
+#define BIG (2 * 1024 * 1024)
+
+static char buf[SIZE];
+static char big[BIG];
+
+static void
+check_data (int handle, const char *what)
+{
+  size_t i;
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\" %s", what);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 253))
+      fail ("byte %zu of \"data\" is wrong %s", i, what);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\"");
+
+  for (i = 0; i < SIZE; i++)
+    ACTUAL[i] = i % 253;
+
+  msg ("push mapped pages out of memory");
+  memset (big, 0x5a, BIG);
+  for (i = 0; i < BIG; i += 4096)
+    if (big[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+
+  CHECK (msync (map), "msync \"data\"");
+  check_data (handle, "after msync");
+
+  munmap (map);
+  check_data (handle, "after munmap");
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync-swap) begin
+(mmap-msync-swap) create "data"
+(mmap-msync-swap) open "data"
+(mmap-msync-swap) mmap "data"
+(mmap-msync-swap) push mapped pages out of memory
+(mmap-msync-swap) msync "data"
+(mmap-msync-swap) read "data" after msync
+(mmap-msync-swap) read "data" after munmap
+(mmap-msync-swap) end
+EOF
+pass;
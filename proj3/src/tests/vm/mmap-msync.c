@@ -0,0 +1,50 @@
+/* Maps a file, writes to several adjacent pages of it through
+   the mapping, and calls msync.  Then, without unmapping, reads
+   the file back with the read system call to verify that the
+   written pages reached the file and the untouched page did not
+   change. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define SIZE (3 * 4096 + 512)   /* Last page is partial. */
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\"");
+
+  /* Write every page but the first. */
+  for (i = 4096; i < SIZE; i++)
+    ACTUAL[i] = i % 251;
+  CHECK (msync (map), "msync \"data\"");
+
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\"");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i < 4096 ? 0 : (char) (i % 251)))
+      fail ("byte %zu of \"data\" is wrong", i);
+
+  /* Now write only the first page. */
+  memset (ACTUAL, 'x', 4096);
+  CHECK (msync (map), "msync \"data\" again");
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\" again");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i < 4096 ? 'x' : (char) (i % 251)))
+      fail ("byte %zu of \"data\" is wrong", i);
+
+  munmap (map);
+  close (handle);
+}
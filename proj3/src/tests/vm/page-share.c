@@ -0,0 +1,73 @@
+/* Runs 4 copies of this program at once, so that their code is
+   shared read-only among them.  Each child checksums the page of
+   code holding main() before and after it pushes most of memory
+   out with writes of its own, and checks both sums against the
+   parent's. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/cksum.h"
+#include "tests/lib.h"
+
+#define CHILD_CNT 4
+#define SIZE (1024 * 1024)
+
+const char *test_name = "page-share";
+
+static char buf[SIZE];
+
+int main (int argc, char *argv[]);
+
+/* Returns the checksum of the page of code holding main(), as
+   a string in SUM. */
+static void
+code_cksum (char sum[16])
+{
+  const void *page = (const void *) ((uintptr_t) main & ~(uintptr_t) 0xfff);
+  snprintf (sum, 16, "%lu", cksum (page, 4096));
+}
+
+static int
+child (const char *expected)
+{
+  char sum[16];
+  size_t i;
+
+  code_cksum (sum);
+  if (strcmp (sum, expected))
+    fail ("code differs from parent's before paging");
+
+  memset (buf, 0x5a, SIZE);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+
+  code_cksum (sum);
+  if (strcmp (sum, expected))
+    fail ("code differs from parent's after paging");
+  return 0x42;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t children[CHILD_CNT];
+  char cmd[32];
+  char sum[16];
+  int i;
+
+  if (argc > 1)
+    return child (argv[1]);
+
+  msg ("begin");
+  code_cksum (sum);
+  snprintf (cmd, sizeof cmd, "page-share %s", sum);
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK ((children[i] = exec (cmd)) != -1, "exec child %d", i);
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (children[i]) == 0x42, "wait for child %d", i);
+  msg ("end");
+  return 0;
+}
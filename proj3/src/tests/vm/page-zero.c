@@ -0,0 +1,33 @@
+/* Reads 1 MB of untouched bss, which must read as zeros, then
+   writes every other page of it and verifies that the written
+   pages hold the new data while the others still read as
+   zeros. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 256
+#define SIZE (PAGE_CNT * 4096)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0", i);
+
+  msg ("write pass");
+  for (i = 0; i < PAGE_CNT; i += 2)
+    memset (buf + i * 4096, 0x5a, 4096);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i / 4096 % 2 == 0 ? 0x5a : 0))
+      fail ("byte %zu has wrong value", i);
+}
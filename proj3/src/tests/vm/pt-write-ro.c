@@ -0,0 +1,17 @@
+/* Runs child-write-ro, which writes to a read-only page that is
+   present in memory, and verifies that the child is killed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  CHECK ((child = exec ("child-write-ro")) != -1, "exec \"child-write-ro\"");
+  quiet = true;
+  CHECK (wait (child) == -1, "wait for child (should return -1)");
+  quiet = false;
+}
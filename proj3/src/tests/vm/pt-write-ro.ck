@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pt-write-ro) begin
+(pt-write-ro) exec "child-write-ro"
+(child-write-ro) begin
+child-write-ro: exit(-1)
+(pt-write-ro) end
+pt-write-ro: exit(0)
+EOF
+pass;
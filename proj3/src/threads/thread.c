@@ -492,10 +492,14 @@ init_thread (struct thread *t, const char *name, int priority)
   /* Initialize the lists */
   list_init(&t->children);
   list_init(&t->files);
-  list_init(&t->supp_page_table);
   list_init(&t->mmaps);
+  lock_init(&t->page_lock);
+  cond_init(&t->page_released);
 
   t->stack_min = PHYS_BASE - PGSIZE;
+  t->exec_file = NULL;
+  t->fault_next = NULL;
+  t->fault_window = 0;
   
   /* Copy the first word of name to process_name */
   int i = 0;
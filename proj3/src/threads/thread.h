@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -95,7 +97,9 @@ struct thread
 
 	struct list children;
 	struct list files;
-	struct list supp_page_table;
+	struct hash supp_page_table;
+	struct lock page_lock;             /* Guards busy in supp_page_table. */
+	struct condition page_released;    /* Signaled when a page is not busy. */
 	struct list mmaps;
 	int file_counter;
 
@@ -104,6 +108,9 @@ struct thread
 	int exit_status;
 	char process_name[16];
 	void * stack_min;
+	struct file * exec_file;           /* Executable, for demand paging. */
+	void * fault_next;                 /* Where a sequential fault lands. */
+	unsigned fault_window;             /* Pages to map around a fault. */
    	
 
 #ifdef USERPROG
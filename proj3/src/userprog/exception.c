@@ -10,11 +10,14 @@
 #include "userprog/process.h"
 #include "vm/page.h"
 #include "vm/frame.h"
+#include "vm/swap.h"
 
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+unsigned fault_around_max = 8;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -115,29 +118,23 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Fills KPAGE with PI's contents: from swap if it was swapped
+   out, otherwise from its file, zeroing the rest.  Only file
+   reads take a lock, the file system's.  Returns false if the
+   file read comes up short. */
 static bool
-load_page (struct page_info * pi, struct thread * t)
+read_page (struct page_info * pi, uint8_t * kpage)
 {
-
-  frame_get_lock();
+  if (pi->swap_location != SWAP_NONE)
+  {
+    swap_read (pi->swap_location, kpage);
+	pi->swap_location = SWAP_NONE;
+	return true;
+  }
 
   size_t page_read_bytes = pi->read_bytes;
   size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-
-  uint8_t * kpage;
-  /* Get a page of memory */
-  if(page_read_bytes != 0)
-    kpage = frame_get_page(PAL_USER,pi);
-  else
-    kpage = frame_get_page(PAL_USER | PAL_ZERO,pi);
-  if (kpage == NULL)
-  {
-	printf ("Cound not acquire frame\n");
-	frame_release_lock();
-	return false;
-  }
-
   if(page_read_bytes != 0)
   {
     /* Load this page. */
@@ -145,50 +142,208 @@ load_page (struct page_info * pi, struct thread * t)
 	
     int bytes_loaded = file_read_at(pi->file,kpage,page_read_bytes,pi->ofs);
 
-    bool loaded = bytes_loaded == (int) page_read_bytes;
-
 	if(got_lock)
 	{
       release_file_lock();
 	}
-	if(!loaded)
+	if(bytes_loaded != (int) page_read_bytes)
 	{
 	  printf ("Failed loading file\n");
 	  printf("Failed at file: %p\n",pi->file);
       printf("bytes to read: %d\n",page_read_bytes);
 	  printf("Bytes_loaded: %d\n",bytes_loaded);
-  	  frame_free_page(kpage);
-	  frame_release_lock();
 	  return false;
 	}
   }
 
-
   memset(kpage + page_read_bytes, 0 , page_zero_bytes);
+  return true;
+}
 
-  /* Add the page to the process's address space. */
-  bool success = (pagedir_get_page (t->pagedir,pi->user_vaddr) == NULL);
- 
-  if(success)
+/* Maps KPAGE, just filled with PI's contents, at PI's address in
+   T and unpins it.  A page read from swap is marked dirty, since
+   it still differs from any file it came from.  On failure,
+   such a page goes back to swap, and PI unpins and lets go of
+   KPAGE, which other processes may still share. */
+static bool
+map_page (struct thread * t, struct page_info * pi, uint8_t * kpage,
+          bool from_swap)
+{
+  if (pagedir_set_page (t->pagedir, pi->user_vaddr, kpage, pi->writable))
   {
-	 success = pagedir_set_page (t->pagedir, pi->user_vaddr,
-					                kpage, pi->writable) ;
+    if (from_swap)
+	  pagedir_set_dirty (t->pagedir, pi->user_vaddr, true);
+	frame_unpin (kpage);
+	return true;
   }
 
-  if(!success)
+  if (from_swap
+      && !swap_write ((void * const *) &kpage, 1, &pi->swap_location))
+    PANIC ("out of swap space");
+  frame_unpin (kpage);
+  frame_release_page (pi);
+  printf ("Failed adding page to page table\n");
+  return false;
+}
+
+/* Swap readahead.  PI's page has just been read back from swap
+   SLOT.  The pages after it in T's address space were
+   probably written out with it, into the slots after its own,
+   so read in those that were while there are free frames. */
+static void
+swap_readahead (struct page_info * pi, uint32_t slot, struct thread * t)
+{
+  for (int i = 1; i < SWAP_CLUSTER; i++)
   {
-    frame_free_page(kpage);
-	  printf ("Failed adding page to page table\n");
-	  frame_release_lock();
-    return false; 
+    uint8_t * upage = pi->user_vaddr + i * PGSIZE;
+	if (!is_user_vaddr (upage))
+	  break;
+
+	struct page_info * next = page_lookup (&t->supp_page_table, upage);
+	if (next == NULL || !page_acquire (t, next, false))
+	  break;
+	if (next->swap_location != slot + i)
+	{
+	  page_release (t, next);
+	  break;
+	}
+
+	uint8_t * kpage = frame_try_get_page (PAL_USER, next);
+	bool mapped = false;
+	if (kpage != NULL)
+	{
+	  read_page (next, kpage);
+	  mapped = map_page (t, next, kpage, true);
+	}
+	page_release (t, next);
+	if (!mapped)
+	  break;
   }
+}
 
-  /* Record the vaddr associated with the kernel page in the 
-   * frame table */
-  //frame_install_page(kpage,pi->user_vaddr,t);
+/* Fault-around.  PI's page, backed by a file, has just been
+   faulted in.  If T's faults are coming in order, the pages after
+   it are likely next, so map up to T's window of them now, while
+   that is cheap: read-only pages that another process already
+   has in a frame are just mapped, and the rest are read into
+   frames that are free already, taking the file system lock once
+   for all of them.  The window doubles, up to fault_around_max,
+   while faults land where the last window ended, and halves when
+   they don't. */
+static void
+fault_around (struct page_info * pi, struct thread * t)
+{
+  if (pi->user_vaddr == t->fault_next)
+    t->fault_window = t->fault_window == 0 ? 1 : t->fault_window * 2;
+  else
+    t->fault_window /= 2;
+  if (t->fault_window > fault_around_max)
+    t->fault_window = fault_around_max;
 
-	  frame_release_lock();
-  return true;
+  uint8_t * upage = pi->user_vaddr + PGSIZE;
+  bool got_lock = false;
+  for (unsigned i = 0; i < t->fault_window; i++, upage += PGSIZE)
+  {
+	if (!is_user_vaddr (upage))
+	  break;
+
+	struct page_info * next = page_lookup (&t->supp_page_table, upage);
+	if (next == NULL || next->file == NULL
+	    || !page_acquire (t, next, false))
+	  break;
+
+	bool mapped = pagedir_get_page (t->pagedir, upage) != NULL;
+	if (!mapped && next->swap_location == SWAP_NONE)
+	{
+	  bool loaded = false;
+	  uint8_t * kpage = next->writable
+	                    ? frame_try_get_page (PAL_USER, next)
+	                    : frame_try_get_shared (next, &loaded);
+	  if (kpage != NULL)
+	  {
+	    if (!loaded && !got_lock)
+	      got_lock = acquire_file_lock ();
+	    if (loaded || read_page (next, kpage))
+	      mapped = map_page (t, next, kpage, false);
+	    else
+	      frame_release_page (next);
+	  }
+	}
+	page_release (t, next);
+	if (!mapped)
+	  break;
+  }
+  if (got_lock)
+    release_file_lock ();
+  t->fault_next = upage;
+}
+
+/* Brings PI's page into memory and maps it in T, the current
+   thread, for a WRITE or a read.  No global lock is held: PI is
+   marked busy, so that an eviction of it finishes first and no
+   other can start, and the new frame is pinned until it is
+   mapped.  Faults in different processes therefore overlap, and
+   only the I/O of a fault waits for the device.
+
+   An anonymous page that is only read maps the shared zero page.
+   The first write to it faults again and gets a frame of its
+   own, zeroed like the zero page. */
+static bool
+load_page (struct page_info * pi, struct thread * t, bool write)
+{
+  page_acquire (t, pi, true);
+  void * mapped = pagedir_get_page (t->pagedir, pi->user_vaddr);
+  if (mapped != NULL && (!write || mapped != frame_zero_page ()))
+  {
+    /* Brought in meanwhile, by swap readahead. */
+    page_release (t, pi);
+	return true;
+  }
+
+  uint32_t slot = pi->swap_location;
+  bool from_swap = slot != SWAP_NONE;
+  bool loaded = false;
+
+  if (pi->file == NULL && !from_swap && !write)
+  {
+    bool success = pagedir_set_page (t->pagedir, pi->user_vaddr,
+                                     frame_zero_page (), false);
+	page_release (t, pi);
+	return success;
+  }
+  if (mapped != NULL)
+    pagedir_clear_page (t->pagedir, pi->user_vaddr);
+
+  uint8_t * kpage;
+  /* Get a page of memory.  Read-only file pages, such as code,
+     share one frame among all processes running the program. */
+  if (pi->file != NULL && !pi->writable && !from_swap)
+    kpage = frame_get_shared (pi, &loaded);
+  else
+    kpage = frame_get_page(PAL_USER,pi);
+  if (kpage == NULL)
+  {
+	printf ("Cound not acquire frame\n");
+	page_release (t, pi);
+	return false;
+  }
+
+  if (!loaded && !read_page (pi, kpage))
+  {
+    frame_release_page (pi);
+	page_release (t, pi);
+	return false;
+  }
+
+  /* Add the page to the process's address space. */
+  bool success = map_page (t, pi, kpage, from_swap);
+  page_release (t, pi);
+
+  if (success && from_swap)
+    swap_readahead (pi, slot, t);
+  else if (success && pi->file != NULL)
+    fault_around (pi, t);
+  return success;
 }
 
 /* Page fault handler.  This is a skeleton that must be filled in
@@ -232,35 +387,29 @@ page_fault (struct intr_frame *f)
 
   struct thread * t = thread_current();
   intr_enable ();
-  struct list * supp_page_table = &t->supp_page_table;
-  struct list_elem *e;
   bool success = false;
   //printf("page fault on vaddr %p\n",fault_addr);
-  for( e = list_begin(supp_page_table); e != list_end(supp_page_table);
-	   e = list_next(e))
-  {
-	struct page_info * pi = list_entry(e, struct page_info,elem);
-	/* Check that the user_vaddr is within one page of the fault_addr */
-	if(pg_no(fault_addr) == pg_no(pi->user_vaddr))
-	{
-//	   printf("It's a match! vaddr = %p\n",pi->user_vaddr);
-       success = load_page(pi,t);
-	   break;
-	}
-  }
+  /* A write to a present page is a write to a read-only page,
+     which nothing can fix unless it is a writable page still
+     mapping the zero page. */
+  struct page_info * pi = page_lookup(&t->supp_page_table, fault_addr);
+  if(pi != NULL && (not_present || (write && pi->writable)))
+    success = load_page(pi,t,write);
 
 
-  if(!success)
+  if(!success && not_present)
   {
     int diff = f->esp - fault_addr;
 	/* Check if we need to grow the stack */
 	if(diff < 32 && diff >= 0){
       //printf("diff: %d\n",diff);
 	  //printf("adding %p to page table\n",t->stack_min - PGSIZE);
-	  page_add(&t->supp_page_table, t->stack_min - PGSIZE,
-		      NULL,0,0,true);
-	  t->stack_min -= PGSIZE;
-	  success = true;
+	  if(page_add(&t->supp_page_table, t->stack_min - PGSIZE,
+		      NULL,0,0,true) != NULL)
+	  {
+	    t->stack_min -= PGSIZE;
+	    success = true;
+	  }
 	}
 
   }
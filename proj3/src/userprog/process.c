@@ -49,6 +49,19 @@ acquire_file_lock(void){
   return false;
 }
 
+/* Like acquire_file_lock(), but gives up instead of waiting if
+ * another thread has the lock.  Returns true if the thread now
+ * has the lock, and sets *GOT_LOCK to whether it must release
+ * it. */
+bool
+try_acquire_file_lock(bool * got_lock){
+  *got_lock = false;
+  if(lock_held_by_current_thread(&file_lock))
+    return true;
+  *got_lock = lock_try_acquire(&file_lock);
+  return *got_lock;
+}
+
 void 
 release_file_lock(void){
   lock_release(&file_lock);
@@ -246,6 +259,21 @@ process_exit (void)
 
   }
 
+  /* Release the frames and swap slots of every page.  A thread
+     has a page table if it got as far as a page directory. */
+  if(cur->pagedir != NULL)
+    page_table_destroy(&cur->supp_page_table);
+
+  /* Close the executable, now that no page is loaded from it */
+  if(cur->exec_file != NULL)
+  {
+    bool got_lock = acquire_file_lock();
+    file_close(cur->exec_file);
+    cur->exec_file = NULL;
+    if(got_lock)
+      release_file_lock();
+  }
+
   /* Modify p_info to show that this child has quit
    * if the parent has not already quit */
   if(cur->p_info != NULL){
@@ -528,42 +556,31 @@ process_mmap(int fd, void * addr)
   int length = file_length(file);
   file = file_reopen(file);
 
-  int pages = length / PGSIZE;
-  int extra = length % PGSIZE;
-  int ofs = 0;
+  size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+  struct hash * supp_table = &thread_current()->supp_page_table;
 
-  struct list * supp_table = &thread_current()->supp_page_table;
-
-  for(int i = 0; i < pages; i++)
+  /* Check if this will overlap something */
+  if(page_cnt == 0 || !page_range_is_free(supp_table,addr,page_cnt))
   {
-	/* Check if this will overlap something */
-	if(is_page(supp_table,addr))
-	{
-	  /* If it does, remove previous page info and return */
-      remove_file_mappings(supp_table,file);
-	  lock_release(&file_lock);
-	  return -1;
-	}
-	page_add(&thread_current()->supp_page_table,(uint8_t*) addr,
-		     file, PGSIZE, ofs, true);
-
-    addr += PGSIZE;
-	ofs += PGSIZE;
+    file_close(file);
+	lock_release(&file_lock);
+	return -1;
   }
 
-  if(extra != 0)
+  for(size_t i = 0; i < page_cnt; i++)
   {
-	/* Check if this will overlap something */
-	if(is_page(supp_table,addr))
+    uint32_t ofs = i * PGSIZE;
+	uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+	struct page_info * pi = page_add(supp_table,(uint8_t*) addr + ofs,
+		                             file, read_bytes, ofs, true);
+	if(pi == NULL)
 	{
-	  /* If it does, remove previous page info and return */
-      remove_file_mappings(supp_table,file);
+	  page_unmap(supp_table,addr,i);
+	  file_close(file);
 	  lock_release(&file_lock);
 	  return -1;
 	}
-    /* Otherwise add the page */
-	page_add(&thread_current()->supp_page_table, (uint8_t*) addr,
-		file, extra, ofs, true);
+	pi->write_back = true;
   }
   
 
@@ -575,6 +592,8 @@ process_mmap(int fd, void * addr)
   struct file_info * mmap = malloc(sizeof(struct file_info));   
   mmap->file = file;
   mmap->fd = mapid; 
+  mmap->addr = addr;
+  mmap->page_cnt = page_cnt;
 
   /* Add the struct to the current thread's list of open files */
   list_push_back(&thread_current()->mmaps,&mmap->elem);
@@ -592,8 +611,15 @@ process_munmap(int mapid)
   struct thread * t = thread_current();
   struct list * mmaps = &t->mmaps;
   struct file_info * fi = get_file_info(mapid,mmaps);
+  if(fi == NULL)
+    return;
+
+  page_unmap(&t->supp_page_table, fi->addr, fi->page_cnt);
 
-  remove_file_mappings(&t->supp_page_table, fi->file);
+  bool got_lock = acquire_file_lock();
+  file_close(fi->file);
+  if(got_lock)
+    release_file_lock();
 
   list_remove(&fi->elem);
   free(fi);
@@ -602,6 +628,20 @@ process_munmap(int mapid)
 
 }
 
+/* Writes the pages of mapping MAPID that have been written back
+ * to its file.  Returns false if MAPID is not a mapping or some
+ * page could not be written for lack of memory. */
+bool
+process_msync(int mapid)
+{
+  struct thread * t = thread_current();
+  struct file_info * fi = get_file_info(mapid,&t->mmaps);
+  if(fi == NULL)
+    return false;
+
+  return page_write_back(&t->supp_page_table, fi->addr, fi->page_cnt);
+}
+
 
 
 /* We load ELF binaries.  The following definitions are taken
@@ -695,6 +735,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
   /* Mark that this is a process */
   t->is_process = true;
 
+  if (!page_table_init (&t->supp_page_table))
+    goto done;
+
   /* Allocate and activate page directory. */
   //TODO pagedir_destroy if this fails later
   t->pagedir = pagedir_create ();
@@ -811,8 +854,12 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.  On
+     success, the file stays open to page the segments in. */
+  if (success)
+    t->exec_file = file;
+  else
+    file_close (file);
 
   lock_release(&file_lock);
   return success;
@@ -879,8 +926,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Nothing is read here.  The pages are recorded in the
+   supplemental page table and loaded by page_fault() when they
+   are first touched, so FILE must stay open while they are in
+   use.
+
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -891,7 +943,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -900,31 +951,15 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+      /* Only record where the page comes from; page_fault()
+         reads it in on first touch.  Pages with nothing to read
+         are plain zero-filled memory. */
       struct thread *t = thread_current ();
-	 struct page_info * pi = page_add(&t->supp_page_table,upage,file,
+	  struct page_info * pi = page_add(&t->supp_page_table,upage,
+		  page_read_bytes != 0 ? file : NULL,
 		  page_read_bytes,ofs,writable);
-	  
-      //uint8_t *kpage = palloc_get_page (PAL_USER);
-      uint8_t *kpage = frame_get_page(PAL_USER,pi);
-      if (kpage == NULL)
-        return false;
-
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          //palloc_free_page (kpage);
-		  frame_free_page(kpage);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-
-
-      if (!install_page (upage, kpage, writable)) 
-        {
-          //palloc_free_page (kpage);
-		  frame_free_page(kpage);
-          return false; 
-        }
+	  if (pi == NULL)
+		return false;
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -946,6 +981,8 @@ setup_stack (void **esp)
   struct thread * t = thread_current();
   struct page_info * pi = page_add(&t->supp_page_table,
 	       ((uint8_t *) PHYS_BASE) - PGSIZE,NULL,0,0,true);
+  if (pi == NULL)
+    return false;
 
   //kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   kpage = frame_get_page (PAL_USER | PAL_ZERO,pi);
@@ -953,7 +990,10 @@ setup_stack (void **esp)
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
       if (success)
+      {
+        frame_unpin (kpage);
         *esp = PHYS_BASE;
+      }
       else
 		frame_free_page(kpage);
         //palloc_free_page (kpage);
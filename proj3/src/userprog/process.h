@@ -22,7 +22,9 @@ uint32_t process_tell(int fd);
 void process_close(int fd);
 int process_mmap(int fd, void * addr);
 void process_munmap(int mapid);
+bool process_msync(int mapid);
 bool acquire_file_lock(void);
+bool try_acquire_file_lock(bool * got_lock);
 void release_file_lock(void);
 
 
@@ -42,6 +44,10 @@ struct file_info
   struct file * file;
   int fd;
   struct list_elem elem;
+
+  /* Mapped range, for mappings only */
+  uint8_t * addr;
+  size_t page_cnt;
 };
 
 #endif /* userprog/process.h */
@@ -26,6 +26,7 @@ static void tell(struct intr_frame *f);
 static void close(struct intr_frame *f);
 static void mmap(struct intr_frame *f);
 static void munmap(struct intr_frame *f);
+static void msync(struct intr_frame *f);
 
 
 
@@ -156,6 +157,10 @@ syscall_handler (struct intr_frame *f)
 	   munmap(f);
 	   break;
 
+    case SYS_MSYNC:
+	   msync(f);
+	   break;
+
 	default:
        printf ("system call unknown!\n");
        thread_exit ();
@@ -300,3 +305,10 @@ munmap(struct intr_frame *f)
   int mapid = get_int(f,1);
   process_munmap(mapid);
 }
+
+static void 
+msync(struct intr_frame *f)
+{
+  int mapid = get_int(f,1);
+  f->eax = process_msync(mapid);
+}
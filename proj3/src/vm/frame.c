@@ -1,152 +1,520 @@
 #include "vm/frame.h"
 #include "threads/palloc.h"
 
+#include <debug.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <hash.h>
 #include <threads/malloc.h>
 #include <threads/palloc.h>
 #include <threads/synch.h>
-#include <devices/timer.h>
+#include <threads/vaddr.h>
+#include "filesys/file.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "vm/swap.h"
 
-struct list frame_table;
+/* One entry per page of the user pool, allocated up front and
+ * indexed by the page's position in the pool, so that finding a
+ * frame is arithmetic and getting one needs no malloc.  Entries
+ * of pages not in use have a null kpage. */
+static struct frame_info * frame_table;
+static uint8_t * frame_base;  /* First page of the user pool. */
+static size_t frame_cnt;      /* Pages in the user pool. */
+static size_t clock_hand;     /* Next frame the clock looks at. */
+static struct hash shared_frames;  /* Shared frames by file data. */
+static void * zero_page;      /* All zeros; see frame_zero_page(). */
 struct lock frame_lock;
-struct lock fault_lock;
+
+static unsigned shared_hash(const struct hash_elem *, void *);
+static bool shared_less(const struct hash_elem *, const struct hash_elem *,
+                        void *);
 
 /* Initialize the frame table */
 void
 frame_init(void)
 {
-  list_init(&frame_table);
+  frame_base = palloc_user_base();
+  frame_cnt = palloc_user_page_cnt();
+  frame_table = calloc(frame_cnt, sizeof *frame_table);
+  zero_page = palloc_get_page(PAL_ZERO);
+  if(frame_table == NULL || zero_page == NULL
+     || !hash_init(&shared_frames, shared_hash, shared_less, NULL))
+    PANIC ("frame table: out of memory");
+  clock_hand = 0;
   lock_init(&frame_lock);
-  lock_init(&fault_lock);
 }
 
-void frame_get_lock(void)
+static unsigned
+shared_hash(const struct hash_elem * e, void * aux UNUSED)
 {
-  lock_acquire(&fault_lock);
+  const struct frame_info * fi = hash_entry(e, struct frame_info,
+                                            shared_elem);
+  return hash_int((int) fi->inode) ^ hash_int(fi->ofs)
+         ^ hash_int(fi->read_bytes);
 }
 
-void frame_release_lock(void)
+static bool
+shared_less(const struct hash_elem * a_, const struct hash_elem * b_,
+            void * aux UNUSED)
 {
-  lock_release(&fault_lock);
+  const struct frame_info * a = hash_entry(a_, struct frame_info,
+                                           shared_elem);
+  const struct frame_info * b = hash_entry(b_, struct frame_info,
+                                           shared_elem);
+  if(a->inode != b->inode)
+    return a->inode < b->inode;
+  if(a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
 }
 
-static void 
-evict_page(void){
+/* Returns the frame table entry for KPAGE, or NULL if KPAGE is
+ * not a user pool page. */
+static struct frame_info *
+find_frame(void * kpage)
+{
+  size_t idx = ((uint8_t *) kpage - frame_base) / PGSIZE;
+  if((uint8_t *) kpage < frame_base || idx >= frame_cnt)
+    return NULL;
+  return &frame_table[idx];
+}
 
-  lock_acquire(&frame_lock);
-  /* Initialize with the first element in the list */
-  struct frame_info * frame_to_evict;
-  frame_to_evict = list_entry(list_front(&frame_table),
-	  						  struct frame_info,elem);
-  struct list_elem *e;
-  for (e = list_begin(&frame_table); e != list_end(&frame_table);
-	   e = list_next(e))
+/* Returns the shared frame holding PI's file data, or NULL.
+ * Must be called with frame_lock held. */
+static struct frame_info *
+find_shared(const struct page_info * pi)
+{
+  struct frame_info key;
+  struct hash_elem * e;
+
+  key.inode = file_get_inode(pi->file);
+  key.ofs = pi->ofs;
+  key.read_bytes = pi->read_bytes;
+  e = hash_find(&shared_frames, &key.shared_elem);
+  return e != NULL ? hash_entry(e, struct frame_info, shared_elem) : NULL;
+}
+
+/* Makes PI one of the pages mapping FI.  Must be called with
+ * frame_lock held. */
+static void
+attach_page(struct frame_info * fi, struct page_info * pi)
+{
+  list_push_back(&fi->pages, &pi->frame_elem);
+  pi->kpage = fi->kpage;
+}
+
+/* Stops PI from mapping its frame and unmaps it from its owner's
+ * page directory.  Must be called with frame_lock held. */
+static void
+detach_page(struct page_info * pi)
+{
+  list_remove(&pi->frame_elem);
+  pagedir_clear_page(pi->owner->pagedir, pi->user_vaddr);
+  pi->kpage = NULL;
+}
+
+/* Frees FI's page and marks FI as no longer in use.  FI must have
+ * no pages left.  Must be called with frame_lock held. */
+static void
+remove_frame(struct frame_info * fi)
+{
+  ASSERT (list_empty(&fi->pages));
+
+  if(fi->inode != NULL)
   {
-    struct frame_info * fi = list_entry(e, struct frame_info, elem);
-	if(fi->access_time < frame_to_evict->access_time)
-	{
-      frame_to_evict = fi;
-	}
+    hash_delete(&shared_frames, &fi->shared_elem);
+    fi->inode = NULL;
+  }
+  palloc_free_page(fi->kpage);
+  fi->kpage = NULL;
+  fi->loading = false;
+}
+
+/* Returns true if any page mapping FI has been accessed, and
+ * clears the accessed bits. */
+static bool
+test_and_clear_accessed(struct frame_info * fi)
+{
+  bool accessed = false;
+  struct list_elem * e;
 
+  for(e = list_begin(&fi->pages); e != list_end(&fi->pages);
+      e = list_next(e))
+  {
+    struct page_info * pi = list_entry(e, struct page_info, frame_elem);
+    uint32_t * pd = pi->owner->pagedir;
+    if(pagedir_is_accessed(pd, pi->user_vaddr))
+    {
+      accessed = true;
+      pagedir_set_accessed(pd, pi->user_vaddr, false);
+    }
   }
+  return accessed;
+}
+
+/* Returns the page mapping private frame FI if it has been
+ * written, and NULL if FI is clean or shared.  Shared frames are
+ * read-only. */
+static struct page_info *
+dirty_page(const struct frame_info * fi)
+{
+  struct page_info * pi;
+
+  if(fi->inode != NULL)
+    return NULL;
+  pi = list_entry(list_front((struct list *) &fi->pages),
+                  struct page_info, frame_elem);
+  return pagedir_is_dirty(pi->owner->pagedir, pi->user_vaddr) ? pi : NULL;
+}
 
-  int swap_location = swap_write(frame_to_evict);
-  //set the swap location in frame_to_evict->pi
-  
-  
-  /* Remove the frame from the pagedir of the owner of 
-   * the evicted frame */
-  pagedir_clear_page(frame_to_evict->owner->pagedir,
-	                 frame_to_evict->pi->user_vaddr);  
+/* Returns true if FI's page costs a write to evict: it has been
+ * written, or has no file to be read back from. */
+static bool
+needs_swap(const struct frame_info * fi)
+{
+  struct page_info * pi = list_entry(list_front((struct list *) &fi->pages),
+                                     struct page_info, frame_elem);
+  return pi->file == NULL || dirty_page(fi) != NULL;
+}
 
- lock_release(&frame_lock); 
+/* Marks every page mapping FI busy, or none of them if one
+ * already is.  Returns true if it marked them. */
+static bool
+acquire_pages(struct frame_info * fi)
+{
+  struct list_elem * e;
 
- // Free this frame 
-   
- frame_free_page(frame_to_evict);
+  for(e = list_begin(&fi->pages); e != list_end(&fi->pages);
+      e = list_next(e))
+  {
+    struct page_info * pi = list_entry(e, struct page_info, frame_elem);
+    if(!page_acquire(pi->owner, pi, false))
+    {
+      while(e != list_begin(&fi->pages))
+      {
+        e = list_prev(e);
+        pi = list_entry(e, struct page_info, frame_elem);
+        page_release(pi->owner, pi);
+      }
+      return false;
+    }
+  }
+  return true;
+}
 
+/* Returns true if frame A should be written out before frame B:
+ * by owner and then address of their first pages. */
+static bool
+victim_less(struct frame_info * a, struct frame_info * b)
+{
+  struct page_info * pa = list_entry(list_front(&a->pages),
+                                     struct page_info, frame_elem);
+  struct page_info * pb = list_entry(list_front(&b->pages),
+                                     struct page_info, frame_elem);
+  if(pa->owner != pb->owner)
+    return pa->owner < pb->owner;
+  return pa->user_vaddr < pb->user_vaddr;
 }
 
-/* Get a page of memory */
-void *
-frame_get_page(enum palloc_flags flags, struct page_info * pi)
+/* Evicts up to SWAP_CLUSTER frames chosen by the clock algorithm.
+ * The hand sweeps the frame table, clearing the accessed bits of
+ * each frame it passes and taking frames whose bits were already
+ * clear.  A frame that would have to go to swap is passed over
+ * once, so that clean file-backed frames, which are just
+ * dropped, go first.  Pinned frames, and frames with a busy
+ * page, are skipped.
+ *
+ * A shared frame is unmapped from every page that maps it.
+ * Written pages of file mappings go back to their files.  Other
+ * pages the owner has written go to swap together, in address
+ * order, so that they land in neighboring slots and can be read
+ * back together.  frame_lock is released during the writes; the
+ * victims stay pinned and their pages busy meanwhile, so their
+ * owners wait for the writes to finish before faulting them back
+ * in.  Returns false if no frame could be evicted.  Must be
+ * called with frame_lock held, and returns with it held. */
+static bool
+evict_pages(void)
 {
+  struct frame_info * victims[SWAP_CLUSTER];
+  void * dirty_pages[SWAP_CLUSTER];
+  struct page_info * dirty_pis[SWAP_CLUSTER];
+  struct list busy_pages;
+  uint32_t slots[SWAP_CLUSTER];
+  size_t cnt = 0, dirty_cnt = 0;
+
+  /* Three laps are enough for every frame's accessed bit to be
+   * cleared and its second chance used up. */
+  for(size_t steps = 0; steps < 3 * frame_cnt && cnt < SWAP_CLUSTER; steps++)
+  {
+    if(clock_hand >= frame_cnt)
+      clock_hand = 0;
+    struct frame_info * fi = &frame_table[clock_hand++];
+    if(fi->kpage == NULL || fi->pin_cnt > 0 || list_empty(&fi->pages))
+      continue;
+
+    if(test_and_clear_accessed(fi))
+    {
+      fi->second_chance = true;
+      continue;
+    }
+    if(fi->second_chance && needs_swap(fi))
+    {
+      fi->second_chance = false;
+      continue;
+    }
+
+    if(!acquire_pages(fi))
+      continue;
+    fi->pin_cnt++;
+
+    /* Insert in order of owner and address. */
+    size_t i = cnt++;
+    while(i > 0 && victim_less(fi, victims[i - 1]))
+    {
+      victims[i] = victims[i - 1];
+      i--;
+    }
+    victims[i] = fi;
+  }
+  if(cnt == 0)
+    return false;
+
+  /* Unmap every victim before writing any of them out, so that
+   * an owner that touches one faults (and waits for us) instead
+   * of changing it under the write.  A shared frame stops being
+   * found for new mappings right away. */
+  list_init(&busy_pages);
+  for(size_t i = 0; i < cnt; i++)
+  {
+    struct frame_info * fi = victims[i];
+    struct page_info * pi = dirty_page(fi);
+    if(pi != NULL)
+    {
+      dirty_pages[dirty_cnt] = fi->kpage;
+      dirty_pis[dirty_cnt++] = pi;
+    }
+    if(fi->inode != NULL)
+    {
+      hash_delete(&shared_frames, &fi->shared_elem);
+      fi->inode = NULL;
+    }
+    while(!list_empty(&fi->pages))
+    {
+      pi = list_entry(list_front(&fi->pages), struct page_info, frame_elem);
+      detach_page(pi);
+      list_push_back(&busy_pages, &pi->frame_elem);
+    }
+  }
+  lock_release(&frame_lock);
+
+  /* Writing a mapped page to its file needs the file system lock.
+   * A thread holding that lock may be waiting for one of these
+   * pages, so if another thread has it, the page goes to swap
+   * after all, for munmap or msync to write back later. */
+  size_t swap_cnt = 0;
+  bool locked = false, got_lock = false;
+  for(size_t i = 0; i < dirty_cnt; i++)
+  {
+    struct page_info * pi = dirty_pis[i];
+    if(pi->write_back
+       && (locked || (locked = try_acquire_file_lock(&got_lock))))
+      file_write_at(pi->file, dirty_pages[i], pi->read_bytes, pi->ofs);
+    else
+    {
+      dirty_pages[swap_cnt] = dirty_pages[i];
+      dirty_pis[swap_cnt++] = pi;
+    }
+  }
+  if(got_lock)
+    release_file_lock();
+
+  if(swap_cnt > 0)
+  {
+    if(!swap_write(dirty_pages, swap_cnt, slots))
+      PANIC ("out of swap space");
+    for(size_t i = 0; i < swap_cnt; i++)
+      dirty_pis[i]->swap_location = slots[i];
+  }
+  while(!list_empty(&busy_pages))
+  {
+    struct page_info * pi = list_entry(list_pop_front(&busy_pages),
+                                       struct page_info, frame_elem);
+    page_release(pi->owner, pi);
+  }
+
   lock_acquire(&frame_lock);
+  for(size_t i = 0; i < cnt; i++)
+  {
+    victims[i]->pin_cnt--;
+    remove_frame(victims[i]);
+  }
+  return true;
+}
+
+/* Gets a frame for PI, evicting other frames if there is none
+ * free and EVICT is true.  The frame is pinned, so that it is not
+ * evicted before it is filled and mapped; see frame_unpin().
+ * Must be called with frame_lock held. */
+static struct frame_info *
+alloc_frame(enum palloc_flags flags, struct page_info * pi, bool evict)
+{
   uint8_t *kpage;
   kpage = palloc_get_page(flags);
 
-  if(kpage == NULL)
-  {
-    //Iterate through the frame list, find least recently used
-	//Evict this, in that supp page table, mark that this has been
-	//moved to swap, remove from that thread's page table
-	//call frame_free_page on that kpage
-	
-	lock_release(&frame_lock);
-	evict_page();
-    lock_acquire(&frame_lock);
-
-	kpage = palloc_get_page(flags);
-  }
+  while(kpage == NULL && evict && evict_pages())
+    kpage = palloc_get_page(flags);
 
+  if(kpage == NULL)
+    return NULL;
 
-  struct frame_info * fi = malloc(sizeof(struct frame_info));
+  struct frame_info * fi = find_frame(kpage);
+  ASSERT (fi != NULL && fi->kpage == NULL);
   fi->kpage = kpage;
-  fi->access_time = timer_ticks();
-  fi->pi = pi;
-  fi->owner = thread_current();
+  list_init(&fi->pages);
+  fi->inode = NULL;
+  fi->second_chance = false;
+  fi->pin_cnt = 1;
+  fi->loading = true;
+  attach_page(fi, pi);
+  return fi;
+}
 
-  list_push_back(&frame_table,&fi->elem);
+/* Get a page of memory */
+void *
+frame_get_page(enum palloc_flags flags, struct page_info * pi)
+{
+  lock_acquire(&frame_lock);
+  struct frame_info * fi = alloc_frame(flags, pi, true);
+  lock_release(&frame_lock);
+  return fi != NULL ? fi->kpage : NULL;
+}
 
+/* Get a page of memory only if one is free, without evicting
+ * anything.  For speculative loads such as swap readahead. */
+void *
+frame_try_get_page(enum palloc_flags flags, struct page_info * pi)
+{
+  lock_acquire(&frame_lock);
+  struct frame_info * fi = alloc_frame(flags, pi, false);
   lock_release(&frame_lock);
-  return kpage;
+  return fi != NULL ? fi->kpage : NULL;
 }
 
-/*
-void
-frame_install_page(void * kpage, void * upage, struct thread * owner)
+/* Gets the frame for PI, a read-only page of file data, sharing
+ * it with every other process that maps the same data.  If
+ * another process already has the data in a frame, sets *LOADED
+ * to true and returns that frame, which the caller need only
+ * map.  Otherwise sets *LOADED to false and returns a new frame
+ * for the caller to fill and map, which later faults on the same
+ * data will share.  Either way the frame is pinned until
+ * frame_unpin().
+ *
+ * A frame that is still being filled is not waited for: its
+ * loader may need the file system lock, which the caller could
+ * be holding.  The caller gets a private frame instead.  A new
+ * frame may evict others if EVICT is true.  Eviction drops
+ * frame_lock, so another process may have started sharing the
+ * same data meanwhile; the new frame then stays private too. */
+static void *
+get_shared(struct page_info * pi, bool * loaded, bool evict)
 {
+  struct frame_info * fi;
+
+  ASSERT (pi->file != NULL && !pi->writable);
+
   lock_acquire(&frame_lock);
-  struct list_elem *e;
-  for (e = list_begin(&frame_table); e != list_end(&frame_table);
-	   e = list_next(e))
+  fi = find_shared(pi);
+  if(fi != NULL && !fi->loading)
   {
-    struct frame_info * fi = list_entry(e, struct frame_info, elem);
-    if(fi->kpage == kpage)
-	{
-	  fi->upage = upage;
-	  fi->owner = owner;
-	}
-  }	
+    fi->pin_cnt++;
+    attach_page(fi, pi);
+    *loaded = true;
+  }
+  else
+  {
+    fi = alloc_frame(PAL_USER, pi, evict);
+    if(fi != NULL)
+    {
+      fi->inode = file_get_inode(pi->file);
+      fi->ofs = pi->ofs;
+      fi->read_bytes = pi->read_bytes;
+      if(hash_insert(&shared_frames, &fi->shared_elem) != NULL)
+        fi->inode = NULL;
+    }
+    *loaded = false;
+  }
+  lock_release(&frame_lock);
+  return fi != NULL ? fi->kpage : NULL;
+}
+
+void *
+frame_get_shared(struct page_info * pi, bool * loaded)
+{
+  return get_shared(pi, loaded, true);
+}
+
+/* Like frame_get_shared(), but only takes a frame that is already
+ * free, without evicting anything. */
+void *
+frame_try_get_shared(struct page_info * pi, bool * loaded)
+{
+  return get_shared(pi, loaded, false);
+}
 
+/* Returns the zero page.  Anonymous pages map it read-only until
+ * they are first written, so that pages that are only read take
+ * no frame.  It comes from the kernel pool and is never in the
+ * frame table, so it is never evicted or freed. */
+void *
+frame_zero_page(void)
+{
+  return zero_page;
+}
+
+/* Makes KPAGE, now mapped, a candidate for eviction, once no
+ * one else has it pinned. */
+void frame_unpin(void * kpage)
+{
+  lock_acquire(&frame_lock);
+  struct frame_info * fi = find_frame(kpage);
+  ASSERT (fi != NULL && fi->kpage == kpage && fi->pin_cnt > 0);
+  fi->pin_cnt--;
+  fi->loading = false;
   lock_release(&frame_lock);
 }
-*/
 
+/* Frees KPAGE.  A user frame must be one of its caller's, pinned
+ * and not yet shared, whose loading failed. */
 void frame_free_page(void * kpage)
 {
   lock_acquire(&frame_lock);
-  /* free the page */
-  palloc_free_page(kpage);  
-
+  struct frame_info * fi = find_frame(kpage);
+  if(fi != NULL && fi->kpage != NULL)
+  {
+    while(!list_empty(&fi->pages))
+      detach_page(list_entry(list_front(&fi->pages),
+                             struct page_info, frame_elem));
+    remove_frame(fi);
+  }
+  else
+    palloc_free_page(kpage);
+  lock_release(&frame_lock);
+}
 
-  /* Remove from list and free allocated memory */
-  struct list_elem *e;
-  struct frame_info * fi = NULL;
-  for (e = list_begin(&frame_table); e != list_end(&frame_table);
-	   e = list_next(e))
+/* Unmaps PI from its frame, if it has one, and frees the frame
+ * once no page maps it.  The caller must have marked PI busy, so
+ * that it is not being evicted. */
+void frame_release_page(struct page_info * pi)
+{
+  lock_acquire(&frame_lock);
+  if(pi->kpage != NULL)
   {
-    fi = list_entry(e, struct frame_info, elem);
-	if(fi->kpage == kpage)
-	{
-      list_remove(e);
-      free(fi);
-	  break;
-	}
+    struct frame_info * fi = find_frame(pi->kpage);
+    detach_page(pi);
+    if(list_empty(&fi->pages))
+      remove_frame(fi);
   }
   lock_release(&frame_lock);
 }
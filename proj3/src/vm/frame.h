@@ -2,34 +2,45 @@
 #define VM_FRAME_H
 
 #include <stdio.h> /* needed for bool? */
+#include <hash.h>
+#include <list.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
+#include "filesys/off_t.h"
 #include "vm/page.h"
 
 void frame_init(void);
 void * frame_get_page(enum palloc_flags flags,struct page_info * pi);
-/*void frame_install_page(void * kpage, 
-	                    void * upage, 
+void * frame_try_get_page(enum palloc_flags flags,struct page_info * pi);
+void * frame_get_shared(struct page_info * pi, bool * loaded);
+void * frame_try_get_shared(struct page_info * pi, bool * loaded);
+void * frame_zero_page(void);
+/*void frame_install_page(void * kpage,
+	                    void * upage,
 						struct thread * owner);
 */
 
 void frame_free_page(void * kpage);
-void frame_get_lock(void);
-void frame_release_lock(void);
+void frame_release_page(struct page_info * pi);
+void frame_unpin(void * kpage);
 
 
 struct frame_info
 {
-  struct list_elem elem;
-  void * kpage;
-  void * upage;
-  struct thread * owner;
-  struct page_info * pi;
-  
-  int64_t access_time;
-  
-  // tid so that when a thread exits it's entries
-  // can be freed
+  void * kpage;             /* Null if the frame is not in use. */
+  struct list pages;        /* page_infos mapping this frame. */
+
+  /* Read-only file pages are shared by every process that maps
+   * the same bytes of the same file.  Such frames are found
+   * through shared_frames by (inode, ofs, read_bytes). */
+  struct inode * inode;     /* Null if the frame is private. */
+  off_t ofs;
+  uint32_t read_bytes;
+  struct hash_elem shared_elem;
+
+  bool second_chance;       /* Recently used; spared if it needs swap. */
+  unsigned pin_cnt;         /* Not evictable while nonzero. */
+  bool loading;             /* Being filled for the first time. */
 
 };
 
@@ -4,31 +4,123 @@
 #include <stdio.h>
 #include "threads/thread.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
 
-struct list supp_page_table;
+/* The supplemental page table is a hash keyed by page number,
+ * so finding the page for a fault does not depend on how many
+ * pages the process has. */
+
+static unsigned
+page_hash(const struct hash_elem * e, void * aux UNUSED)
+{
+  const struct page_info * pi = hash_entry(e, struct page_info, elem);
+  return hash_int(pg_no(pi->user_vaddr));
+}
+
+static bool
+page_less(const struct hash_elem * a, const struct hash_elem * b,
+          void * aux UNUSED)
+{
+  return pg_no(hash_entry(a, struct page_info, elem)->user_vaddr)
+         < pg_no(hash_entry(b, struct page_info, elem)->user_vaddr);
+}
 
 static struct page_info *
-get_pi(struct list * supp_page_table,
+get_pi(struct hash * supp_page_table,
 	   uint8_t* user_vaddr)
 {
-  struct list_elem *e;
-  for (e = list_begin(supp_page_table); e != list_end(supp_page_table);
-	   e = list_next(e))
+  struct page_info key;
+  struct hash_elem * e;
+
+  key.user_vaddr = pg_round_down(user_vaddr);
+  e = hash_find(supp_page_table, &key.elem);
+  return e != NULL ? hash_entry(e, struct page_info, elem) : NULL;
+}
+
+/* Marks PI, a page of OWNER, busy while its frame or swap slot
+ * changes hands.  A busy page is neither evicted nor loaded, so
+ * only one of those is ever in progress.  If PI is already busy,
+ * waits for it to be released if WAIT is true, and otherwise
+ * returns false. */
+bool page_acquire(struct thread * owner, struct page_info * pi, bool wait)
+{
+  lock_acquire(&owner->page_lock);
+  while(pi->busy)
   {
-    struct page_info * pi = list_entry(e, struct page_info,elem);
-    if(pg_no(pi->user_vaddr) == pg_no(user_vaddr))
-    {
-	  return pi;
-    }
+    if(!wait)
+	{
+	  lock_release(&owner->page_lock);
+	  return false;
+	}
+	cond_wait(&owner->page_released, &owner->page_lock);
   }
-  return NULL;
+  pi->busy = true;
+  lock_release(&owner->page_lock);
+  return true;
+}
+
+/* Releases PI, a page of OWNER, marked busy by page_acquire(). */
+void page_release(struct thread * owner, struct page_info * pi)
+{
+  lock_acquire(&owner->page_lock);
+  pi->busy = false;
+  cond_broadcast(&owner->page_released, &owner->page_lock);
+  lock_release(&owner->page_lock);
+}
+
+/* Frees PI's frame or swap slot, whichever holds its data, and
+ * then PI itself, once any eviction of it is done.  PI must
+ * already be out of its table.  A page without a frame may still
+ * map the zero page, which must not be freed with the page
+ * directory. */
+static void
+discard_page(struct page_info * pi)
+{
+  struct thread * t = thread_current();
+  page_acquire(t, pi, true);
+  if(pi->kpage == NULL)
+    pagedir_clear_page(t->pagedir, pi->user_vaddr);
+  frame_release_page(pi);
+  if(pi->swap_location != SWAP_NONE)
+    swap_free(pi->swap_location);
+  free(pi);
 }
 
-struct page_info * page_add(struct list * supp_page_table,
+static void
+discard_page_elem(struct hash_elem * e, void * aux UNUSED)
+{
+  discard_page(hash_entry(e, struct page_info, elem));
+}
+
+/* Initializes an empty table.  Returns false if out of memory. */
+bool page_table_init(struct hash * supp_page_table)
+{
+  return hash_init(supp_page_table, page_hash, page_less, NULL);
+}
+
+/* Frees every page in SUPP_PAGE_TABLE, along with the frames and
+ * swap slots holding them, when a process exits. */
+void page_table_destroy(struct hash * supp_page_table)
+{
+  hash_destroy(supp_page_table, discard_page_elem);
+}
+
+struct page_info *
+page_lookup(struct hash * supp_page_table,
+	        uint8_t * user_vaddr)
+{
+  return get_pi(supp_page_table,user_vaddr);
+}
+
+/* Adds a page at USER_VADDR.  Returns NULL if out of memory or if
+ * the table already has a page there. */
+struct page_info * page_add(struct hash * supp_page_table,
 	            uint8_t* user_vaddr,
 				struct file * file,
 				uint32_t read_bytes,
@@ -38,106 +130,192 @@ struct page_info * page_add(struct list * supp_page_table,
 
   //printf("adding %p\n",user_vaddr);
   struct page_info * pi = malloc(sizeof(struct page_info));
+  if(pi == NULL)
+    return NULL;
   pi->user_vaddr = user_vaddr;
+  pi->owner = thread_current();
+  pi->kpage = NULL;
   pi->file = file;
   pi->read_bytes = read_bytes;
   pi->writable = writable;
   pi->ofs = ofs;
-  pi->swap_location = -1;
+  pi->write_back = false;
+  pi->swap_location = SWAP_NONE;
+  pi->busy = false;
 
-  list_push_back(supp_page_table,&pi->elem);
+  if(hash_insert(supp_page_table,&pi->elem) != NULL)
+  {
+    free(pi);
+    return NULL;
+  }
 
   return pi;
 }
 
-void page_remove(struct list * supp_page_table,
+void page_remove(struct hash * supp_page_table,
 				 uint8_t * user_vaddr)
 {
-  struct list_elem *e;
-  for (e = list_begin(supp_page_table); e != list_end(supp_page_table);
-	   e = list_next(e))
-  {
-    struct page_info * pi = list_entry(e, struct page_info,elem);
-    if(pi->user_vaddr == user_vaddr)
-    {
-      list_remove(e);
-	  pagedir_clear_page(thread_current()->pagedir,user_vaddr);
-      free(pi);
-      break;
-    }
-  }
-  /*
   struct page_info * pi = get_pi(supp_page_table,user_vaddr);
   if(pi != NULL)
   {
-    list_remove(&pi->elem);
-    free(pi);
+    hash_delete(supp_page_table, &pi->elem);
+	discard_page(pi);
   }
-  */
 }
 
-bool is_page(struct list * supp_page_table, 
+bool is_page(struct hash * supp_page_table, 
 	         uint8_t * user_vaddr)
 {
-  /*
-  struct list_elem *e;
-  for (e = list_begin(supp_page_table); e != list_end(supp_page_table);
-	   e = list_next(e))
-  {
-    struct page_info * pi = list_entry(e, struct page_info,elem);
-	//printf("User: %p In table: %p\n",user_vaddr,pi->user_vaddr);
-    if(pg_no(pi->user_vaddr) == pg_no(user_vaddr))
-    {
-	  return true;
-    }
-  }
-  return false;
-  struct page_info * pi = get_pi(supp_page_table,user_vaddr);
-  if(pi == NULL)
-	return false;
-  else 
-	return true;
-  */
-  return get_pi(supp_page_table,user_vaddr);
+  return get_pi(supp_page_table,user_vaddr) != NULL;
 }
 
-bool is_read_only(struct list * supp_page_table,
+bool is_read_only(struct hash * supp_page_table,
 				  uint8_t * user_vaddr)
 {
   struct page_info * pi = get_pi(supp_page_table,user_vaddr);
   return !pi->writable;
 }
 
-void remove_file_mappings(struct list * supp_page_table, 
-	                      struct file * file)
+/* Returns true if none of the PAGE_CNT pages from START is in
+ * the table. */
+bool page_range_is_free(struct hash * supp_page_table,
+                        uint8_t * start, size_t page_cnt)
 {
+  for(size_t i = 0; i < page_cnt; i++)
+    if(get_pi(supp_page_table, start + i * PGSIZE) != NULL)
+	  return false;
+  return true;
+}
 
-  struct list_elem *e = list_begin(supp_page_table);
+/* Removes the PAGE_CNT file-backed pages from START, as when a
+ * mapping is unmapped, writing back those that were written.
+ * Pages in the range that are not in the table are skipped. */
+void page_unmap(struct hash * supp_page_table,
+                uint8_t * start, size_t page_cnt)
+{
+  /* Freeing a page whose data is only in swap would lose it, so
+   * wait for memory to write it back instead. */
+  while(!page_write_back(supp_page_table, start, page_cnt))
+    thread_yield();
 
-  while (e != list_end(supp_page_table))
+  for(size_t i = 0; i < page_cnt; i++)
   {
-	struct list_elem * f = list_next(e); 
-    struct page_info * pi = list_entry(e, struct page_info,elem);
-    if(pi->file == file)
-    {
-	  //Check if dirty
-	  //write to file
-	  uint32_t * pd = thread_current()->pagedir;
-	  acquire_file_lock();
-	  if(pagedir_is_dirty(pd,pi->user_vaddr)) /*||
-	   	pagedir_is_dirty(pd, pagedir_get_page(pd,
-			                          pi->user_vaddr)))*/
-	  {
-		file_write(file,pi->user_vaddr,pi->read_bytes);
-	  }
+    struct page_info * pi = get_pi(supp_page_table, start + i * PGSIZE);
+	if(pi == NULL)
+	  continue;
+
+	hash_delete(supp_page_table, &pi->elem);
+	discard_page(pi);
+  }
+}
 
-	  release_file_lock(); 
+/* Writes the RUN_CNT pages from RUN, all in memory, written and
+ * busy, to their file in one write, straight from the mapping,
+ * and then marks them clean and releases them. */
+static void
+write_run(struct hash * supp_page_table, uint8_t * run, size_t run_cnt)
+{
+  struct thread * t = thread_current();
+  struct page_info * first = get_pi(supp_page_table, run);
+  struct page_info * last = get_pi(supp_page_table,
+                                   run + (run_cnt - 1) * PGSIZE);
+  off_t size = (run_cnt - 1) * PGSIZE + last->read_bytes;
+
+  bool got_lock = acquire_file_lock();
+  file_write_at(first->file, run, size, first->ofs);
+  if(got_lock)
+    release_file_lock();
 
-      list_remove(e);
-	  pagedir_clear_page(thread_current()->pagedir,pi->user_vaddr);
-      free(pi);
-    }
-	e = f;
+  for(size_t i = 0; i < run_cnt; i++)
+  {
+    struct page_info * pi = get_pi(supp_page_table, run + i * PGSIZE);
+	pagedir_set_dirty(t->pagedir, pi->user_vaddr, false);
+	page_release(t, pi);
   }
+}
+
+/* Writes PI, a busy page of a mapping that was written and then
+ * evicted to swap, back to its file.  The page is read into a
+ * frame of its own for the write, or into a kernel page if no
+ * frame can be had, and afterward is clean and out of memory, to
+ * be read from the file when next touched.  Returns false, with
+ * the page still in swap, if there is no memory for it at all. */
+static bool
+write_swapped(struct page_info * pi)
+{
+  void * kpage = frame_get_page(PAL_USER, pi);
+  bool frame = kpage != NULL;
+  if(!frame)
+    kpage = palloc_get_page(0);
+  if(kpage == NULL)
+    return false;
+
+  swap_read(pi->swap_location, kpage);
+  pi->swap_location = SWAP_NONE;
+  bool got_lock = acquire_file_lock();
+  file_write_at(pi->file, kpage, pi->read_bytes, pi->ofs);
+  if(got_lock)
+    release_file_lock();
+  if(frame)
+    frame_release_page(pi);
+  else
+    palloc_free_page(kpage);
+  return true;
+}
 
+/* Writes the pages of the mapping at START, PAGE_CNT pages long,
+ * that have been written since they were read from its file or
+ * last written back, as msync does, and marks them clean.  Pages
+ * that were not written cost no I/O.  Runs of written pages that
+ * are in memory, one after another in the file, go out in a
+ * single write; written pages that were evicted to swap are read
+ * back one at a time.  Each page is busy until it is written, so
+ * it cannot be evicted with the old data on disk.  Returns false
+ * if a page in swap could not be written for lack of memory; it
+ * stays dirty in swap, and the rest are still written. */
+bool page_write_back(struct hash * supp_page_table,
+                     uint8_t * start, size_t page_cnt)
+{
+  struct thread * t = thread_current();
+  bool success = true;
+  uint8_t * run = NULL;        /* First page of the current run. */
+  size_t run_cnt = 0;
+  off_t run_end = 0;           /* File offset just past the run. */
+
+  for(size_t i = 0; i < page_cnt; i++)
+  {
+    struct page_info * pi = get_pi(supp_page_table, start + i * PGSIZE);
+	if(pi == NULL || !pi->write_back)
+	  continue;
+
+	page_acquire(t, pi, true);
+	if(pi->kpage != NULL && pagedir_is_dirty(t->pagedir, pi->user_vaddr))
+	{
+	  if(run_cnt > 0 && pi->user_vaddr == run + run_cnt * PGSIZE
+	     && (off_t) pi->ofs == run_end)
+	    run_cnt++;
+	  else
+	  {
+	    if(run_cnt > 0)
+	      write_run(supp_page_table, run, run_cnt);
+	    run = pi->user_vaddr;
+	    run_cnt = 1;
+	  }
+	  run_end = pi->ofs + pi->read_bytes;
+	  continue;
+	}
+
+	if(run_cnt > 0)
+	{
+	  write_run(supp_page_table, run, run_cnt);
+	  run_cnt = 0;
+	}
+	if(pi->kpage == NULL && pi->swap_location != SWAP_NONE
+	   && !write_swapped(pi))
+	  success = false;
+	page_release(t, pi);
+  }
+  if(run_cnt > 0)
+    write_run(supp_page_table, run, run_cnt);
+  return success;
 }
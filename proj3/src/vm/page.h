@@ -3,29 +3,45 @@
 
 #include "threads/thread.h"
 #include "filesys/file.h"
+#include <hash.h>
 #include <inttypes.h>
 #include <stdio.h>
 
-void page_init(void);
-struct page_info * page_add(struct list * supp_page_table,
+bool page_table_init(struct hash * supp_page_table);
+void page_table_destroy(struct hash * supp_page_table);
+
+struct page_info * page_add(struct hash * supp_page_table,
 				uint8_t* user_vaddr,
 				struct file * file,
 				uint32_t read_bytes,
 				uint32_t ofs,
 				bool writable);
-void page_remove(struct list * supp_page_table,
+void page_remove(struct hash * supp_page_table,
+				 uint8_t * user_vaddr);
+struct page_info * page_lookup(struct hash * supp_page_table,
 				 uint8_t * user_vaddr);
 
-bool is_page(struct list * supp_page_table,
+bool is_page(struct hash * supp_page_table,
 				 uint8_t * user_vaddr);
-bool is_read_only(struct list * supp_page_table,
+bool is_read_only(struct hash * supp_page_table,
 				 uint8_t * user_vaddr);
 
-void remove_file_mappings(struct list * supp_page_table, 
-	 				      struct file * file);
+bool page_acquire(struct thread * owner, struct page_info * pi, bool wait);
+void page_release(struct thread * owner, struct page_info * pi);
+
+bool page_range_is_free(struct hash * supp_page_table,
+				 uint8_t * start, size_t page_cnt);
+void page_unmap(struct hash * supp_page_table,
+				 uint8_t * start, size_t page_cnt);
+bool page_write_back(struct hash * supp_page_table,
+				 uint8_t * start, size_t page_cnt);
+
 struct page_info
 {
-  struct list_elem elem;
+  struct hash_elem elem;
+  struct thread * owner;        /* Process whose page this is. */
+  struct list_elem frame_elem;  /* In the pages of its frame. */
+  void * kpage;                 /* Frame holding the page, or NULL. */
   
   // The address
   uint8_t* user_vaddr;
@@ -35,7 +51,9 @@ struct page_info
   uint32_t read_bytes;
   uint32_t ofs;
   bool writable;
-  uint32_t swap_location;
+  bool write_back;          /* Written data goes back to FILE (mmap). */
+  uint32_t swap_location;   /* Swap slot, or SWAP_NONE. */
+  bool busy;                /* Being loaded, evicted or freed. */
 };
 
 #endif /* vm/page.h */
@@ -1,33 +1,124 @@
 #include "vm/swap.h"
-#include "vm/frame.h"
+#include <debug.h>
 #include "devices/block.h"
 #include "lib/kernel/bitmap.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Sectors in one page-sized swap slot. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
 static struct block * global_swap_block;
-static struct bitmap * swap_map;
+static struct bitmap * swap_map;   /* One bit per slot, true if in use. */
+static size_t next_slot;           /* Where the next slot search starts. */
+static struct lock swap_lock;      /* Protects swap_map and next_slot. */
 
+/* Sizes the slot map from the swap device.  Without a swap
+   device every swap_write() fails. */
 void swap_init(void)
 {
+  lock_init(&swap_lock);
   global_swap_block = block_get_role (BLOCK_SWAP);
-  swap_map = bitmap_create(1000);
+  if(global_swap_block == NULL)
+    return;
+
+  size_t slot_cnt = block_size(global_swap_block) / SLOT_SECTORS;
+  if(slot_cnt > 0)
+  {
+    swap_map = bitmap_create(slot_cnt);
+    if(swap_map == NULL)
+      PANIC ("swap: cannot allocate map for %zu slots", slot_cnt);
+  }
+  next_slot = 0;
+}
 
+/* Marks CNT consecutive free slots used and returns the first,
+   searching forward from where the last search stopped and
+   then from the start.  Returns BITMAP_ERROR if there is no
+   such run.  Must be called with swap_lock held. */
+static size_t
+alloc_slots(size_t cnt)
+{
+  size_t slot = bitmap_scan_and_flip(swap_map, next_slot, cnt, false);
+  if(slot == BITMAP_ERROR && next_slot != 0)
+    slot = bitmap_scan_and_flip(swap_map, 0, cnt, false);
+  if(slot != BITMAP_ERROR)
+  {
+    next_slot = slot + cnt;
+    if(next_slot >= bitmap_size(swap_map))
+      next_slot = 0;
+  }
+  return slot;
 }
 
-int swap_write(struct frame_info * fi)
+/* Writes the CNT pages in KPAGES to swap and stores the slot of
+   each in SLOTS.  The pages go to as few runs of consecutive
+   slots as free space allows, so that they are written, and
+   later read back, with short seeks.  Returns false without
+   writing anything if swap does not have CNT free slots. */
+bool swap_write(void * const kpages[], size_t cnt, uint32_t slots[])
 {
-  /* Find an open position in the bitmap and read
-   * the data from the frame into the location  * 8 
-   * on the block, then return that location */
+  size_t done = 0;
+  size_t run = cnt;
+
+  if(swap_map == NULL)
+    return false;
+
+  lock_acquire(&swap_lock);
+  while(done < cnt)
+  {
+    size_t slot;
 
-  return -1;
+    if(run > cnt - done)
+      run = cnt - done;
+    slot = alloc_slots(run);
+    if(slot == BITMAP_ERROR)
+    {
+      if(run > 1)
+      {
+        /* No room for a run that long.  Try shorter ones. */
+        run /= 2;
+        continue;
+      }
 
+      /* Out of swap.  Give back what this call took. */
+      while(done-- > 0)
+        bitmap_reset(swap_map, slots[done]);
+      lock_release(&swap_lock);
+      return false;
+    }
+
+    for(size_t i = 0; i < run; i++)
+      slots[done++] = slot + i;
+  }
+  lock_release(&swap_lock);
+
+  /* The slots are ours now, so the I/O needs no lock. */
+  for(size_t i = 0; i < cnt; i++)
+    for(size_t s = 0; s < SLOT_SECTORS; s++)
+      block_write(global_swap_block, slots[i] * SLOT_SECTORS + s,
+                  (uint8_t *) kpages[i] + s * BLOCK_SECTOR_SIZE);
+  return true;
 }
 
-void swap_read(int position, void * buffer)
+/* Reads the page in SLOT into KPAGE and frees the slot. */
+void swap_read(uint32_t slot, void * kpage)
 {
+  ASSERT (swap_map != NULL && bitmap_test(swap_map, slot));
 
-  /* Read the data from position in the block into the
-   * buffer that is a frame location */
-
+  for(size_t s = 0; s < SLOT_SECTORS; s++)
+    block_read(global_swap_block, slot * SLOT_SECTORS + s,
+               (uint8_t *) kpage + s * BLOCK_SECTOR_SIZE);
+  swap_free(slot);
 }
 
+/* Frees SLOT without reading it, for pages that are discarded
+   while swapped out. */
+void swap_free(uint32_t slot)
+{
+  ASSERT (swap_map != NULL && bitmap_test(swap_map, slot));
+
+  lock_acquire(&swap_lock);
+  bitmap_reset(swap_map, slot);
+  lock_release(&swap_lock);
+}
@@ -1,14 +1,23 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
-#include "vm/frame.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/* swap_location of a page that is not in swap. */
+#define SWAP_NONE ((uint32_t) -1)
+
+/* Most pages written out or read back together. */
+#define SWAP_CLUSTER 8
 
 void swap_init(void);
 
-int swap_write(struct frame_info *);
+bool swap_write(void * const kpages[], size_t cnt, uint32_t slots[]);
+
+void swap_read(uint32_t slot, void * kpage);
 
-void swap_read(int position, void * buffer);
+void swap_free(uint32_t slot);
 
 
 #endif /* vm/swap.h */
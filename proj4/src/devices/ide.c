@@ -1,6 +1,7 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
@@ -34,6 +35,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +51,16 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Largest number of sectors moved per interrupt that we ask a
+   disk for with SET MULTIPLE MODE. */
+#define MULTIPLE_MAX 16
+
+/* Largest number of sectors in one READ or WRITE command. */
+#define COMMAND_SECTORS_MAX 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +69,23 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt in READ/WRITE
+                                   MULTIPLE, or 0 if not in use. */
+    block_sector_t head;        /* Sector after the last one moved. */
+  };
+
+/* A read or write of CNT consecutive sectors, queued on the
+   disk's channel until the channel gets to it. */
+struct ide_request
+  {
+    struct list_elem elem;      /* Element in queue or active list. */
+    struct ata_disk *disk;      /* Disk to transfer to or from. */
+    bool write;                 /* Write rather than read? */
+    block_sector_t sec_no;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void **buffers;             /* One buffer per sector. */
+    size_t done;                /* Sectors transferred so far. */
+    struct semaphore complete;  /* Up'd when the request is done. */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +96,17 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Request queue.  Shared with the interrupt handler, so only
+       touched with interrupts off. */
+    struct list queue;          /* Requests waiting to be started. */
+    struct list active;         /* Requests in the current command. */
+    struct ide_request *xfer;   /* Active request being transferred. */
+    size_t xfer_left;           /* Sectors left in the current command. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,8 +119,9 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int max_multiple);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,6 +131,12 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static void submit_request (struct ide_request *);
+static void start_command (struct channel *);
+static void transfer_block (struct channel *);
+static void finish_command (struct channel *);
+static bool wait_drq (const struct ata_disk *);
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
@@ -123,9 +165,12 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      list_init (&c->active);
+      c->xfer = NULL;
+      c->xfer_left = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +181,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->head = 0;
         }
 
       /* Register interrupt handler. */
@@ -265,6 +312,7 @@ identify_ata_device (struct ata_disk *d)
   char *model, *serial;
   char extra_info[128];
   struct block *block;
+  int max_multiple;
 
   ASSERT (d->is_ata);
 
@@ -284,6 +332,7 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  max_multiple = *(uint16_t *) &id[47 * 2] & 0xff;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -303,6 +352,9 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Move several sectors per interrupt if the disk can. */
+  set_multiple_mode (d, max_multiple);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,6 +389,84 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Turns on READ/WRITE MULTIPLE for disk D, which can move up to
+   MAX_MULTIPLE sectors per interrupt according to its IDENTIFY
+   DEVICE data, with the largest power of 2 up to MULTIPLE_MAX that
+   fits.  Leaves it off if the disk cannot do it or refuses. */
+static void
+set_multiple_mode (struct ata_disk *d, int max_multiple) 
+{
+  struct channel *c = d->channel;
+  int multiple = MULTIPLE_MAX;
+
+  while (multiple > max_multiple)
+    multiple /= 2;
+  if (multiple < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = multiple;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and BUFFERS, one sector per buffer, writing if WRITE is true
+   and reading otherwise.  The transfer is queued on D's channel
+   in pieces of up to COMMAND_SECTORS_MAX sectors, and this
+   returns once all of them are done. */
+static void
+transfer (struct ata_disk *d, bool write, block_sector_t sec_no,
+          size_t cnt, void **buffers)
+{
+  while (cnt > 0)
+    {
+      struct ide_request r;
+
+      r.disk = d;
+      r.write = write;
+      r.sec_no = sec_no;
+      r.cnt = cnt < COMMAND_SECTORS_MAX ? cnt : COMMAND_SECTORS_MAX;
+      r.buffers = buffers;
+      r.done = 0;
+      sema_init (&r.complete, 0);
+      submit_request (&r);
+      sema_down (&r.complete);
+
+      sec_no += r.cnt;
+      buffers += r.cnt;
+      cnt -= r.cnt;
+    }
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS, one sector per buffer, each of which must have room
+   for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffers[])
+{
+  transfer (d_, false, sec_no, cnt, buffers);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS, one sector per buffer, each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving all of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffers[])
+{
+  transfer (d_, true, sec_no, cnt, (void **) buffers);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -344,16 +474,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d_, sec_no, 1, &buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +485,191 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_write_multiple (d_, sec_no, 1, &buffer);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
+/* Request scheduling.
+
+   Each channel keeps a queue of requests and runs one ATA command
+   at a time.  The next request is picked in C-SCAN order: the one
+   on its disk closest at or after where the disk's last command
+   ended, wrapping around to the lowest sector once there is none
+   further out.  Queued requests for the sectors right after it,
+   in the same direction, are chained onto the same command.  The
+   interrupt handler moves the data and starts the next command
+   itself, so callers only sleep until their own request is done. */
+
+/* Queues R on its disk's channel and starts it if the channel is
+   idle. */
+static void
+submit_request (struct ide_request *r) 
+{
+  struct channel *c = r->disk->channel;
+  enum intr_level old_level = intr_disable ();
+
+  list_push_back (&c->queue, &r->elem);
+  if (list_empty (&c->active))
+    start_command (c);
+  intr_set_level (old_level);
+}
+
+/* Returns how far past the head of its disk R starts, counting
+   forward and wrapping around at the end of the disk. */
+static block_sector_t
+seek_distance (const struct ide_request *r) 
+{
+  return r->sec_no - r->disk->head;
+}
+
+/* Removes from C's queue and returns the request that C-SCAN
+   serves next, or a null pointer if the queue is empty. */
+static struct ide_request *
+pick_request (struct channel *c) 
+{
+  struct ide_request *best = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+      if (best == NULL || seek_distance (r) < seek_distance (best))
+        best = r;
+    }
+  if (best != NULL)
+    list_remove (&best->elem);
+  return best;
+}
+
+/* Removes from C's queue and returns a request that continues
+   right where LAST ends, in the same direction, if there is one
+   and the command would still fit in COMMAND_SECTORS_MAX sectors
+   with TOTAL already in it. */
+static struct ide_request *
+pick_adjacent (struct channel *c, const struct ide_request *last,
+               size_t total) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+      if (r->disk == last->disk && r->write == last->write
+          && r->sec_no == last->sec_no + last->cnt
+          && total + r->cnt <= COMMAND_SECTORS_MAX)
+        {
+          list_remove (&r->elem);
+          return r;
+        }
+    }
+  return NULL;
+}
+
+/* Starts the command for the next requests in C's queue, if any.
+   Must be called with interrupts off and no command active. */
+static void
+start_command (struct channel *c) 
+{
+  struct ide_request *first, *r;
+  struct ata_disk *d;
+  size_t total;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (list_empty (&c->active));
+
+  first = pick_request (c);
+  if (first == NULL)
+    return;
+  list_push_back (&c->active, &first->elem);
+  total = first->cnt;
+  for (r = first; (r = pick_adjacent (c, r, total)) != NULL; )
+    {
+      list_push_back (&c->active, &r->elem);
+      total += r->cnt;
+    }
+
+  d = first->disk;
+  c->xfer = first;
+  c->xfer_left = total;
+  d->head = first->sec_no + total;
+
+  select_sectors (d, first->sec_no, total);
+  if (first->write)
+    {
+      /* The disk asks for the first block of data right away and
+         interrupts when it wants each later one. */
+      issue_pio_command (c, d->multiple > 0
+                         ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+      if (!wait_drq (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, first->sec_no);
+      transfer_block (c);
+    }
+  else
+    issue_pio_command (c, d->multiple > 0
+                       ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+}
+
+/* Moves the next block of the active command on channel C, as
+   many sectors as the disk transfers per interrupt, between the
+   data register and the requests' buffers. */
+static void
+transfer_block (struct channel *c) 
+{
+  struct ide_request *r = c->xfer;
+  size_t per_intr = r->disk->multiple > 0 ? r->disk->multiple : 1;
+  size_t n = c->xfer_left < per_intr ? c->xfer_left : per_intr;
+
+  for (; n > 0; n--, c->xfer_left--)
+    {
+      while (r->done == r->cnt)
+        r = list_entry (list_next (&r->elem), struct ide_request, elem);
+      if (r->write)
+        output_sector (c, r->buffers[r->done++]);
+      else
+        input_sector (c, r->buffers[r->done++]);
+    }
+  c->xfer = r;
+}
+
+/* Wakes up the owners of the requests in the active command on
+   channel C, which has finished, and starts the next command. */
+static void
+finish_command (struct channel *c) 
+{
+  while (!list_empty (&c->active))
+    {
+      struct ide_request *r = list_entry (list_pop_front (&c->active),
+                                          struct ide_request, elem);
+      sema_up (&r->complete);
+    }
+  c->xfer = NULL;
+  start_command (c);
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between 1
+   and COMMAND_SECTORS_MAX, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= COMMAND_SECTORS_MAX);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % COMMAND_SECTORS_MAX);  /* 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -407,8 +683,9 @@ static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
+     up'd by the completion handler, unless the command belongs to
+     a queued request, which the handler carries on by itself. */
+  ASSERT (intr_get_level () == INTR_ON || !list_empty (&c->active));
 
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
@@ -446,7 +723,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +756,25 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Waits up to 100 ms for disk D to clear BSY, without sleeping,
+   and then returns the status of the DRQ bit.  Usable with
+   interrupts off. */
+static bool
+wait_drq (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 10000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +785,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -511,7 +807,24 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (!list_empty (&c->active))
+          {
+            struct ide_request *r = c->xfer;
+            uint8_t status = inb (reg_status (c)); /* Acknowledge. */
+
+            if (c->xfer_left == 0)
+              finish_command (c);
+            else if (!(status & STA_DRQ) || (status & STA_ERR))
+              PANIC ("%s: disk %s failed, sector=%"PRDSNu, r->disk->name,
+                     r->write ? "write" : "read", r->sec_no + r->done);
+            else
+              {
+                transfer_block (c);
+                if (c->xfer_left == 0 && !r->write)
+                  finish_command (c);
+              }
+          }
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
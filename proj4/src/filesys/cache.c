@@ -7,17 +7,54 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "lib/kernel/list.h"
+#include "lib/kernel/hash.h"
 #include "devices/timer.h"
 
 #define CACHE_SIZE 64
 
-struct lock io_lock;
-struct lock stack_lock;
-struct lock main_lock;
+/* Most sectors moved in one multi-sector request. */
+#define IO_RUN_MAX 16
 
-struct list lru_stack;
+/* Protects the index, the LRU queue and the bookkeeping fields
+   of every entry.  Never held across disk I/O. */
+struct lock index_lock;
 
-bool running;
+/* Protects the in-memory copy of the free map. */
+struct lock map_lock;
+
+/* Signaled when an entry's rw_count drops to zero. */
+struct condition entry_free;
+
+/* Entries with unwritten changes, and how many there are. */
+static struct list dirty_list;
+static int dirty_cnt;
+
+/* The write-behind thread sleeps WRITE_BEHIND_MS between sweeps
+   when little of the cache is dirty, and less as more of it is. */
+#define WRITE_BEHIND_MS 1000
+
+/* Maps a sector number to the cache entry holding it.
+   Only entries that are in use are in the index. */
+struct hash cache_index;
+
+/* Next entry that has never been used, so that a miss
+   does not have to scan the cache for an empty slot. */
+static int next_unused;
+
+static unsigned long long hit_cnt;
+static unsigned long long miss_cnt;
+
+bool running;                      /* Cleared to stop the cache threads. */
+
+/* Read-ahead requests, serviced by the read-ahead thread.
+   Requests that do not fit are dropped, since they are only
+   hints. */
+#define READ_AHEAD_QUEUE 32
+static block_sector_t ra_queue[READ_AHEAD_QUEUE];
+static int ra_head;                /* Oldest request. */
+static int ra_cnt;                 /* Number of queued requests. */
+static struct lock ra_lock;
+static struct condition ra_ready;  /* Signaled when ra_cnt > 0. */
 
 struct cache_entry
 {
@@ -25,241 +62,625 @@ struct cache_entry
   uint8_t* data;
   bool dirty;
   bool used;
-  struct lock entry_lock;
+  bool loading;                 /* Data is being brought in. */
+  bool accessed;                /* Used since the clock hand passed. */
+  struct condition io_done;     /* Signaled when loading ends. */
+  struct lock entry_lock;       /* Protects data. */
   int rw_count;
   struct list_elem elem;
+  struct list_elem dirty_elem;  /* Element in dirty_list. */
+  struct hash_elem hash_elem;
 };
 
 struct cache_entry cache[CACHE_SIZE];
 uint8_t* free_map;
 
+/* A replacement policy.  All hooks are called with index_lock
+   held. */
+struct cache_policy
+{
+  const char *name;
+  void (*init) (void);
+
+  /* Records an access to E. */
+  void (*access) (struct cache_entry *e);
+
+  /* Returns an entry with rw_count 0 to evict, or NULL if every
+     entry is in use. */
+  struct cache_entry *(*choose) (void);
+};
+
+/* Clock: a hit only sets the accessed bit, and the hand gives
+   each accessed entry a second chance.  Clean entries are
+   preferred so that a miss rarely has to write back first. */
+
+/* How many entries past the first dirty candidate to look at
+   for a clean one before settling for the dirty one. */
+#define CLEAN_SEARCH 8
+
+static int clock_hand;
+
 static void
-cache_flush(void)
+clock_init (void)
 {
-  for(int i = 0; i < CACHE_SIZE; i++)
+  clock_hand = 0;
+}
+
+static void
+clock_access (struct cache_entry *e)
+{
+  e->accessed = true;
+}
+
+static struct cache_entry *
+clock_choose (void)
+{
+  struct cache_entry *dirty_victim = NULL;
+  int searched = 0;
+
+  for (int i = 0; i < 2 * CACHE_SIZE; i++)
+  {
+	if (dirty_victim != NULL && ++searched > CLEAN_SEARCH)
+	  break;
+
+	struct cache_entry *e = &cache[clock_hand];
+	clock_hand = (clock_hand + 1) % CACHE_SIZE;
+	if (e->rw_count > 0)
+	  continue;
+	if (e->accessed)
+	{
+	  e->accessed = false;
+	  continue;
+	}
+	if (!e->dirty)
+	  return e;
+	if (dirty_victim == NULL)
+	  dirty_victim = e;
+  }
+  return dirty_victim;
+}
+
+/* LRU: every access moves the entry to the back of a queue. */
+static struct list lru_stack;
+
+static void
+lru_init (void)
+{
+  list_init (&lru_stack);
+  for (int i = 0; i < CACHE_SIZE; i++)
+	list_push_back (&lru_stack, &cache[i].elem);
+}
+
+static void
+lru_access (struct cache_entry *e)
+{
+  list_remove (&e->elem);
+  list_push_back (&lru_stack, &e->elem);
+}
+
+static struct cache_entry *
+lru_choose (void)
+{
+  struct list_elem *e;
+  for (e = list_begin (&lru_stack); e != list_end (&lru_stack);
+	   e = list_next (e))
   {
-    struct cache_entry * e = &cache[i];
-	lock_acquire(&io_lock);
-	lock_acquire(&e->entry_lock);
-	if(e->dirty)
+	struct cache_entry *ce = list_entry (e, struct cache_entry, elem);
+	if (ce->rw_count == 0)
+	  return ce;
+  }
+  return NULL;
+}
+
+static const struct cache_policy policies[] =
+{
+  {"clock", clock_init, clock_access, clock_choose},
+  {"lru", lru_init, lru_access, lru_choose},
+};
+
+static const struct cache_policy *policy = &policies[0];
+
+/* Selects the replacement policy named NAME.
+   Must be called before cache_init(). */
+void
+cache_select_policy (const char *name)
+{
+  for (size_t i = 0; name != NULL && i < sizeof policies / sizeof *policies;
+	   i++)
+	if (!strcmp (name, policies[i].name))
 	{
-	 block_write(fs_device,e->sector_id,
-			e->data);
-    }
+	  policy = &policies[i];
+	  return;
+	}
+  PANIC ("unknown cache policy `%s'", name);
+}
+
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *ce = hash_entry (e, struct cache_entry,
+	                                         hash_elem);
+  return hash_int (ce->sector_id);
+}
+
+static bool
+cache_less (const struct hash_elem *a, const struct hash_elem *b,
+	        void *aux UNUSED)
+{
+  const struct cache_entry *ca = hash_entry (a, struct cache_entry,
+	                                         hash_elem);
+  const struct cache_entry *cb = hash_entry (b, struct cache_entry,
+	                                         hash_elem);
+  return ca->sector_id < cb->sector_id;
+}
+
+/* Returns the entry holding SECTOR_ID, or NULL if it is
+   not in the cache.  Must be called with index_lock held. */
+static struct cache_entry *
+index_find (block_sector_t sector_id)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector_id = sector_id;
+  e = hash_find (&cache_index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, hash_elem) : NULL;
+}
+
+/* Drops a reference to E.  Must be called with index_lock held. */
+static void
+unpin_entry(struct cache_entry * e)
+{
+  ASSERT (e->rw_count > 0);
+  if(--e->rw_count == 0)
+	cond_signal(&entry_free,&index_lock);
+}
+
+/* Marks E as modified.  Must be called with index_lock held. */
+static void
+set_dirty(struct cache_entry * e)
+{
+  if(!e->dirty)
+  {
+	e->dirty = true;
+	list_push_back(&dirty_list,&e->dirty_elem);
+	dirty_cnt++;
+  }
+}
+
+/* Marks E as matching the disk.  Must be called with index_lock
+   held. */
+static void
+clear_dirty(struct cache_entry * e)
+{
+  if(e->dirty)
+  {
+	e->dirty = false;
+	list_remove(&e->dirty_elem);
+	dirty_cnt--;
+  }
+}
+
+/* Writes E, which the caller has pinned, back to disk.  E is only
+   marked clean once the write is done.  Writers copy into E under
+   entry_lock, so a change made during the write waits for it and
+   then marks E dirty again. */
+static void
+write_back(struct cache_entry * e)
+{
+  lock_acquire(&e->entry_lock);
+  block_write(fs_device,e->sector_id,e->data);
+  lock_acquire(&index_lock);
+  clear_dirty(e);
+  lock_release(&index_lock);
+  lock_release(&e->entry_lock);
+}
+
+/* Writes the CNT pinned entries in RUN, which hold consecutive
+   sectors in order, back to disk with a single request, and then
+   marks them clean as write_back() does. */
+static void
+write_back_run(struct cache_entry ** run, int cnt)
+{
+  const void * buffers[IO_RUN_MAX];
+  int i;
 
-	lock_release(&e->entry_lock);
-	lock_release(&io_lock);
+  for(i = 0; i < cnt; i++)
+  {
+	lock_acquire(&run[i]->entry_lock);
+	buffers[i] = run[i]->data;
+  }
+  block_write_multiple(fs_device,run[0]->sector_id,cnt,buffers);
+  lock_acquire(&index_lock);
+  for(i = 0; i < cnt; i++)
+	clear_dirty(run[i]);
+  lock_release(&index_lock);
+  for(i = 0; i < cnt; i++)
+	lock_release(&run[i]->entry_lock);
+}
+
+static int
+compare_sectors(const void *a_, const void *b_, void *aux UNUSED)
+{
+  const struct cache_entry * a = *(struct cache_entry * const *) a_;
+  const struct cache_entry * b = *(struct cache_entry * const *) b_;
+  return a->sector_id < b->sector_id ? -1 : a->sector_id > b->sector_id;
+}
+
+/* Writes every dirty entry back to disk in sector order, each run
+   of consecutive sectors as one request.  Each entry is pinned
+   while it is written, so only accesses to those sectors wait. */
+static void
+cache_flush(void)
+{
+  struct cache_entry * batch[CACHE_SIZE];
+  int cnt = 0;
+  struct list_elem *le;
+
+  lock_acquire(&index_lock);
+  for(le = list_begin(&dirty_list); le != list_end(&dirty_list);
+	  le = list_next(le))
+  {
+	struct cache_entry * e = list_entry(le, struct cache_entry, dirty_elem);
+	if(e->loading)
+	  continue;
+	e->rw_count++;
+	batch[cnt++] = e;
+  }
+  lock_release(&index_lock);
+
+  sort(batch, cnt, sizeof *batch, compare_sectors, NULL);
+
+  for(int i = 0; i < cnt; )
+  {
+	int n = 1;
+	while(i + n < cnt && n < IO_RUN_MAX
+		  && batch[i + n]->sector_id == batch[i]->sector_id + n)
+	  n++;
+	write_back_run(batch + i, n);
+
+	lock_acquire(&index_lock);
+	for(; n > 0; n--, i++)
+	  unpin_entry(batch[i]);
+	lock_release(&index_lock);
   }
 } 
 
+/* Writes dirty entries back in the background, more often the
+   larger the share of the cache that is dirty. */
 static void 
-auto_save(void *aux UNUSED)
+write_behind_daemon(void *aux UNUSED)
 {
   while(running)
   {
     cache_flush();
-    timer_msleep(100);
-  }
 
+	/* Halve the interval for every quarter of the cache that is
+	   dirty.  dirty_cnt is only a hint here, so no lock. */
+	int quarters = dirty_cnt * 4 / CACHE_SIZE;
+    timer_msleep(WRITE_BEHIND_MS >> quarters);
+  }
 }
 
+static void read_ahead_daemon(void *aux);
+
 void
 cache_init()
 {
-  list_init(&lru_stack);
-  lock_init(&stack_lock);
-  lock_init(&io_lock);
-  lock_init(&main_lock);
+  lock_init(&index_lock);
+  lock_init(&map_lock);
+  cond_init(&entry_free);
+  list_init(&dirty_list);
+  dirty_cnt = 0;
+  if (!hash_init (&cache_index, cache_hash, cache_less, NULL))
+	PANIC ("cache index creation failed");
+  next_unused = 0;
   free_map = malloc(BLOCK_SECTOR_SIZE);
   block_read(fs_device,FREE_MAP_DATA,free_map);
 
   for(int i = 0; i < CACHE_SIZE; i++)
   {
     lock_init(&cache[i].entry_lock);
+	cond_init(&cache[i].io_done);
 	cache[i].data = malloc(BLOCK_SECTOR_SIZE);
 	cache[i].used= false;
 	cache[i].dirty= false;
+	cache[i].loading = false;
+	cache[i].accessed = false;
 	cache[i].rw_count = 0;
-	list_push_back(&lru_stack,&cache[i].elem);
   }
+  policy->init();
+
+  lock_init(&ra_lock);
+  cond_init(&ra_ready);
+  ra_head = ra_cnt = 0;
+
   running = true;
-  //thread_create("AutoSaveCache",PRI_DEFAULT,&auto_save,NULL);
+  thread_create("WriteBehind",PRI_DEFAULT,&write_behind_daemon,NULL);
+  thread_create("ReadAhead",PRI_DEFAULT,&read_ahead_daemon,NULL);
 }	
 
+/* Asks the replacement policy for an idle entry, writes it back
+   if it is dirty, and removes it from the index.  Returns the entry
+   pinned for the caller, or NULL if the caller has to look the
+   sector up again because index_lock was dropped.
+   Must be called with index_lock held. */
 static struct cache_entry *
 evict_block(void)
 {
-  lock_acquire(&stack_lock);
-  struct cache_entry * entry_to_evict  = NULL;
-  while(!entry_to_evict)
+  struct cache_entry * entry_to_evict = policy->choose();
+
+  /* Every entry is busy, wait for one to be released */
+  if(!entry_to_evict)
   {
-	struct list_elem *e;
-	for( e = list_begin (&lru_stack); e != list_end (&lru_stack);
-		 e = list_next(e))
-	  {
-		struct cache_entry * ce = list_entry (e, struct cache_entry,elem);
-		lock_acquire(&ce->entry_lock);
-        if(ce->rw_count == 0)
-		{
-	      entry_to_evict = ce;
-		  ce->used = false;
-		  lock_release(&ce->entry_lock);
-		  break;
-		}
-		lock_release(&ce->entry_lock);
-	  }
+	cond_wait(&entry_free,&index_lock);
+	return NULL;
   }
-  lock_release(&stack_lock);
 
+  entry_to_evict->rw_count++;
   if(entry_to_evict->dirty)
   {
-	block_write(fs_device,entry_to_evict->sector_id,
-				entry_to_evict->data);
+	/* Write back without holding index_lock.  The entry stays in
+	   the index so its sector is never read back stale. */
+	lock_release(&index_lock);
+	write_back(entry_to_evict);
+	lock_acquire(&index_lock);
+
+	/* Someone used the entry in the meantime, so leave it alone */
+	if(entry_to_evict->rw_count > 1 || entry_to_evict->dirty)
+	{
+	  unpin_entry(entry_to_evict);
+	  return NULL;
+	}
   }
 
+  hash_delete(&cache_index,&entry_to_evict->hash_elem);
+  entry_to_evict->used = false;
   return entry_to_evict;
 }
+
+/* Marks E's data as valid and wakes up anyone waiting for it. */
+static void
+finish_load(struct cache_entry * e)
+{
+  lock_acquire(&index_lock);
+  e->loading = false;
+  cond_broadcast(&e->io_done,&index_lock);
+  lock_release(&index_lock);
+}
+
+/* Returns the cache entry for SECTOR_ID with its rw_count
+   raised, bringing the sector in from disk if needed.
+   If NEW, the sector is not read from disk and the caller must
+   fill the data and call finish_load(). */
 static struct cache_entry *
 locate_data(block_sector_t sector_id, bool new){
 
-  // Check if the data is already in the cache 
-  // Doesn't need to happen if new
-  if(!new)
+  struct cache_entry * e;
+
+  lock_acquire(&index_lock);
+  for(;;)
   {
-   for(int i = 0; i < CACHE_SIZE; i++)
-   {
-	lock_acquire(&cache[i].entry_lock);
-    if(cache[i].sector_id == sector_id && cache[i].used)
+	// Check if the data is already in the cache 
+	e = index_find(sector_id);
+	if(e)
 	{
-      // printf("found it at block %i\n",i);
-	  cache[i].rw_count++;
-	  lock_release(&cache[i].entry_lock);
-	  return &cache[i];
+	  e->rw_count++;
+	  hit_cnt++;
+
+	  // Only wait on I/O for this sector
+	  while(e->loading)
+		cond_wait(&e->io_done,&index_lock);
+	  lock_release(&index_lock);
+	  return e;
 	}
-	lock_release(&cache[i].entry_lock);
-   }
-  }
-
-  //Acquire I/O lock
-  lock_acquire(&io_lock);
-
-  struct cache_entry * e = NULL;
-
-  // Find an unused entry 
-  for(int i = 0; i < CACHE_SIZE; i++)
-  {
-	if(!cache[i].used)
-	  e = &cache[i];	
 
-	// Check if the data is now in the cache after acquiring the lock
-	if(cache[i].sector_id == sector_id)
+	// Take an entry that has never been used, otherwise evict someone 
+	if(next_unused < CACHE_SIZE)
 	{
-	  lock_acquire(&cache[i].entry_lock);
-	  cache[i].rw_count++;
-	  lock_release(&cache[i].entry_lock);
-      lock_release(&io_lock);
-	  return &cache[i];
+	  e = &cache[next_unused++];
+	  e->rw_count++;
+	  break;
 	}
+	e = evict_block();
+	if(e)
+	  break;
   }
+  miss_cnt++;
 
-
-  // If there was no empty block, evict someone 
-  // Loop until an empty cache spot is found
-  if(!e)
-    e = evict_block();
-
-  // Bring in new data
-  lock_acquire(&e->entry_lock);
+  // Claim the entry for the new sector before doing any I/O
   e->sector_id = sector_id;
-  e->dirty = false;
   e->used = true;
-  e->rw_count++;
+  e->loading = true;
+  hash_insert(&cache_index,&e->hash_elem);
+  lock_release(&index_lock);
 
   // If this is not a new inode, get previous data */
   if(!new)
   {
     block_read(fs_device,sector_id,e->data);
+	finish_load(e);
   }
 
-  lock_release(&e->entry_lock);
-  lock_release(&io_lock);
   return e;
 }
 
+/* Drops the caller's reference to E, marking it dirty if it was
+   written, and tells the replacement policy about the access. */
+static void
+release_entry(struct cache_entry * e, bool dirty)
+{
+  lock_acquire(&index_lock);
+  if(dirty)
+	set_dirty(e);
+  policy->access(e);
+  unpin_entry(e);
+  lock_release(&index_lock);
+}
+
+/* Reads the CNT entries in RUN, which have been claimed for
+   consecutive sectors but not loaded, with a single request, then
+   makes them available and drops the reader's references. */
+static void
+load_run(struct cache_entry ** run, int cnt)
+{
+  void * buffers[IO_RUN_MAX];
+  int i;
+
+  if(cnt == 0)
+	return;
+  for(i = 0; i < cnt; i++)
+	buffers[i] = run[i]->data;
+  block_read_multiple(fs_device,run[0]->sector_id,cnt,buffers);
+
+  for(i = 0; i < cnt; i++)
+	finish_load(run[i]);
+  lock_acquire(&index_lock);
+  for(i = 0; i < cnt; i++)
+	unpin_entry(run[i]);
+  lock_release(&index_lock);
+}
+
+/* Brings the CNT sectors starting at SECTOR_ID into the cache,
+   skipping any that are there already and reading each run of
+   missing ones with a single request.  The entries are not
+   marked as accessed, so a block that is read ahead but never
+   used is the first to go. */
+static void
+cache_prefetch(block_sector_t sector_id, int cnt)
+{
+  struct cache_entry * run[IO_RUN_MAX];
+  int run_cnt = 0;
+
+  ASSERT (cnt <= IO_RUN_MAX);
+  for(int i = 0; i < cnt; i++)
+  {
+	lock_acquire(&index_lock);
+	bool cached = index_find(sector_id + i) != NULL;
+	lock_release(&index_lock);
+
+	/* A new entry is still loading when it comes back, while one
+	   someone else brought in meanwhile is not. */
+	struct cache_entry * e = NULL;
+	if(!cached)
+	{
+	  e = locate_data(sector_id + i, true);
+	  if(!e->loading)
+	  {
+		lock_acquire(&index_lock);
+		unpin_entry(e);
+		lock_release(&index_lock);
+		e = NULL;
+	  }
+	}
+
+	if(e)
+	  run[run_cnt++] = e;
+	else
+	{
+	  load_run(run, run_cnt);
+	  run_cnt = 0;
+	}
+  }
+  load_run(run, run_cnt);
+}
+
+/* Services read-ahead requests, taking runs of consecutive
+   sectors off the queue together. */
+static void
+read_ahead_daemon(void *aux UNUSED)
+{
+  while(running)
+  {
+	lock_acquire(&ra_lock);
+	while(ra_cnt == 0)
+	  cond_wait(&ra_ready,&ra_lock);
+	block_sector_t sector_id = ra_queue[ra_head];
+	int cnt = 0;
+	do
+	{
+	  ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+	  ra_cnt--;
+	  cnt++;
+	}
+	while(ra_cnt > 0 && cnt < IO_RUN_MAX
+		  && ra_queue[ra_head] == sector_id + cnt);
+	lock_release(&ra_lock);
+
+	cache_prefetch(sector_id, cnt);
+  }
+}
+
+/* Asks the read-ahead thread to bring SECTOR_ID into the cache.
+   Returns without waiting for the read. */
+void
+cache_read_ahead(block_sector_t sector_id)
+{
+  lock_acquire(&ra_lock);
+  if(ra_cnt < READ_AHEAD_QUEUE)
+  {
+	ra_queue[(ra_head + ra_cnt) % READ_AHEAD_QUEUE] = sector_id;
+	ra_cnt++;
+	cond_signal(&ra_ready,&ra_lock);
+  }
+  lock_release(&ra_lock);
+}
+
 void cache_read_map(void *buffer,int ofs,size_t size)
 {
-  lock_acquire(&main_lock);
+  lock_acquire(&map_lock);
   memcpy(buffer,free_map + ofs,size);
-  lock_release(&main_lock);
+  lock_release(&map_lock);
 }
 
 void
 cache_read(block_sector_t sector_id, void* buffer, 
 	            int ofs, size_t size)
 {
-
-  lock_acquire(&main_lock);
   struct cache_entry * e = locate_data(sector_id, false);
-  //locate_data(sector_id +1,false);
   lock_acquire(&e->entry_lock);
   memcpy (buffer, e->data + ofs, size);
-  e->rw_count--;
   lock_release(&e->entry_lock);
-
-  //add to back of queue
-  lock_acquire(&stack_lock);
-  list_remove(&e->elem);
-  list_push_back(&lru_stack,&e->elem);
-  lock_release(&stack_lock);
-  lock_release(&main_lock);
+  release_entry(e, false);
 }
 
 void 
 cache_write_map(const void * buffer,int ofs,size_t size)
 {
-  lock_acquire(&main_lock);
+  lock_acquire(&map_lock);
   memcpy(free_map + ofs,buffer,size);
-  lock_release(&main_lock);
+  lock_release(&map_lock);
 }
 
 void cache_write(block_sector_t sector_id, const void * buffer,
 				 int ofs, size_t size)
 {
-  lock_acquire(&main_lock);
   struct cache_entry * e = locate_data(sector_id, false);
-  //locate_data(sector_id +1,false);
   lock_acquire(&e->entry_lock);
   memcpy(e->data + ofs, buffer, size);
-  e->rw_count--;
-  e->dirty = true;
   lock_release(&e->entry_lock);
-
-  lock_acquire(&stack_lock);
-  list_remove(&e->elem);
-  list_push_back(&lru_stack,&e->elem);
-  lock_release(&stack_lock);
-  lock_release(&main_lock);
+  release_entry(e, true);
 }
 
 void cache_create(block_sector_t sector_id, void * buffer)
 {
-  lock_acquire(&main_lock);
   struct cache_entry * e = locate_data(sector_id, true);
   lock_acquire(&e->entry_lock);
   memcpy(e->data, buffer, BLOCK_SECTOR_SIZE);
-  e->rw_count--;
-  e->dirty = true;
   lock_release(&e->entry_lock);
-
-  /* Put in back of queue */
-  lock_acquire(&stack_lock);
-  list_remove(&e->elem);
-  list_push_back(&lru_stack,&e->elem);
-  lock_release(&stack_lock);
-  lock_release(&main_lock);
+  finish_load(e);
+  release_entry(e, true);
 }
 
 
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache (%s): %llu hits, %llu misses\n",
+		  policy->name, hit_cnt, miss_cnt);
+}
+
 void
 cache_close(void)
 {
@@ -4,13 +4,16 @@
 #include <stdbool.h>
 #include "devices/block.h"
 
+void cache_select_policy(const char *);
 void cache_init(void);
 void cache_read(block_sector_t, void*, int, size_t);
+void cache_read_ahead(block_sector_t);
 void cache_read_map(void*,int,size_t);
 void cache_write(block_sector_t,const void*, int, size_t);
 void cache_write_map(const void*,int,size_t);
 void cache_create(block_sector_t sector_id, void * buffer);
 void cache_close(void);
+void cache_print_stats(void);
 
 
 #endif /* filesys/cache.h */
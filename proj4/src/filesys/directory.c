@@ -1,11 +1,14 @@
 #include "filesys/directory.h"
+#include <hash.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 /* A directory. */
 struct dir 
@@ -24,12 +27,281 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directories are stored in one of two formats.
+
+   A linear directory, the original format, is a plain array of
+   struct dir_entry that is searched from the beginning.
+
+   A hashed directory starts with a struct dir_header sector,
+   followed by one sector per hash bucket, each holding
+   BUCKET_ENTRIES entries.  A name's bucket is found from its
+   hash by linear hashing: when an insert finds its bucket full,
+   the bucket at SPLIT is split in two, so the table grows one
+   bucket at a time and lookups read a single bucket. */
+
+/* Identifies a hashed directory.  It overlays the inode_sector
+   of a linear directory's first entry, which can never be this
+   large. */
+#define DIR_MAGIC 0x48534944
+
+/* Entries in one bucket sector. */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Stop splitting, and fail the insert, once the table has been
+   doubled this many times. */
+#define MAX_LEVEL 16
+
+/* First sector of a hashed directory. */
+struct dir_header
+  {
+    block_sector_t magic;               /* DIR_MAGIC. */
+    uint32_t base_cnt;                  /* Buckets at level 0. */
+    uint32_t level;                     /* Times the table has doubled. */
+    uint32_t split;                     /* Next bucket to split. */
+  };
+
+/* A hash bucket, one sector long. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - BUCKET_ENTRIES * sizeof (struct dir_entry)];
+  };
+
+/* Serializes changes to directories and to the dentry cache. */
+static struct lock dir_lock;
+
+/* The dentry cache remembers the results of recent lookups,
+   keyed by the directory's inode sector and the name looked up,
+   so that looking the same name up again doesn't read directory
+   data.  A negative entry records that the name was not found.
+   Entries are recycled least recently used first. */
+#define DENTRY_CNT 64
+
+struct dentry
+  {
+    block_sector_t dir_sector;          /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    bool used;                          /* In dentry_index? */
+    bool positive;                      /* Was NAME found? */
+    block_sector_t inode_sector;        /* If so, its inode sector. */
+    struct hash_elem hash_elem;         /* Element in dentry_index. */
+    struct list_elem lru_elem;          /* Element in dentry_lru. */
+  };
+
+static struct dentry dentries[DENTRY_CNT];
+static struct hash dentry_index;        /* Used entries. */
+static struct list dentry_lru;          /* All entries, most recent first. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  size_t i;
+
+  lock_init (&dir_lock);
+  hash_init (&dentry_index, dentry_hash, dentry_less, NULL);
+  list_init (&dentry_lru);
+  for (i = 0; i < DENTRY_CNT; i++)
+    list_push_back (&dentry_lru, &dentries[i].lru_elem);
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir_sector);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir_sector != b->dir_sector)
+    return a->dir_sector < b->dir_sector;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the dentry for NAME in the directory whose inode is in
+   DIR_SECTOR, or a null pointer if there is none.  Must be
+   called with dir_lock held. */
+static struct dentry *
+dentry_find (block_sector_t dir_sector, const char *name) 
+{
+  struct dentry key, *d;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir_sector = dir_sector;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_index, &key.hash_elem);
+  if (e == NULL)
+    return NULL;
+
+  d = hash_entry (e, struct dentry, hash_elem);
+  list_remove (&d->lru_elem);
+  list_push_front (&dentry_lru, &d->lru_elem);
+  return d;
+}
+
+/* Records that NAME in the directory whose inode is in
+   DIR_SECTOR refers to INODE_SECTOR if POSITIVE is true, or does
+   not exist otherwise.  Must be called with dir_lock held. */
+static void
+dentry_store (block_sector_t dir_sector, const char *name, bool positive,
+              block_sector_t inode_sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  d = dentry_find (dir_sector, name);
+  if (d == NULL)
+    {
+      d = list_entry (list_back (&dentry_lru), struct dentry, lru_elem);
+      if (d->used)
+        hash_delete (&dentry_index, &d->hash_elem);
+      d->dir_sector = dir_sector;
+      strlcpy (d->name, name, sizeof d->name);
+      d->used = true;
+      hash_insert (&dentry_index, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      list_push_front (&dentry_lru, &d->lru_elem);
+    }
+  d->positive = positive;
+  d->inode_sector = inode_sector;
+}
+
+/* Drops every dentry for names in the directory whose inode is
+   in DIR_SECTOR, which is being removed, so that they can't be
+   mistaken for entries of a later directory in the same sector.
+   Must be called with dir_lock held. */
+static void
+dentry_purge (block_sector_t dir_sector) 
+{
+  size_t i;
+
+  for (i = 0; i < DENTRY_CNT; i++) 
+    {
+      struct dentry *d = &dentries[i];
+      if (d->used && d->dir_sector == dir_sector)
+        {
+          hash_delete (&dentry_index, &d->hash_elem);
+          d->used = false;
+          list_remove (&d->lru_elem);
+          list_push_back (&dentry_lru, &d->lru_elem);
+        }
+    }
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  h.magic = DIR_MAGIC;
+  h.base_cnt = 1;
+  while (h.base_cnt * BUCKET_ENTRIES < entry_cnt)
+    h.base_cnt *= 2;
+  h.level = 0;
+  h.split = 0;
+
+  if (!inode_create (sector, (h.base_cnt + 1) * BLOCK_SECTOR_SIZE))
+    return false;
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  success = inode_write_at (inode, &h, sizeof h, 0) == sizeof h;
+  inode_close (inode);
+  return success;
+}
+
+/* Reads the header of DIR into *H.  Returns true if DIR is a
+   hashed directory, false if it is linear. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) 
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Returns the byte offset of BUCKET in a hashed directory. */
+static off_t
+bucket_ofs (size_t bucket) 
+{
+  return (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that holds names with hash HASH under
+   header H. */
+static size_t
+hash_bucket (const struct dir_header *h, unsigned hash) 
+{
+  size_t cnt = h->base_cnt << h->level;
+  size_t bucket = hash & (cnt - 1);
+  if (bucket < h->split)
+    bucket = hash & (2 * cnt - 1);
+  return bucket;
+}
+
+/* Splits the next bucket of the hashed directory DIR, whose
+   header is H, moving the entries that now hash to the new
+   bucket at the end of the table.  Updates H.  Returns true if
+   successful, false on failure. */
+static bool
+split_bucket (struct dir *dir, struct dir_header *h) 
+{
+  size_t cnt = h->base_cnt << h->level;
+  size_t old_idx = h->split;
+  size_t new_idx = old_idx + cnt;
+  struct dir_bucket *old, *new;
+  size_t i;
+  bool success = false;
+
+  old = malloc (sizeof *old);
+  new = calloc (1, sizeof *new);
+  if (old == NULL || new == NULL
+      || inode_read_at (dir->inode, old, sizeof *old,
+                        bucket_ofs (old_idx)) != sizeof *old)
+    goto done;
+
+  for (i = 0; i < BUCKET_ENTRIES; i++)
+    if (old->entries[i].in_use
+        && (hash_string (old->entries[i].name) & (2 * cnt - 1)) == new_idx)
+      {
+        new->entries[i] = old->entries[i];
+        old->entries[i].in_use = false;
+      }
+
+  if (++h->split == cnt)
+    {
+      h->level++;
+      h->split = 0;
+    }
+  success = (inode_write_at (dir->inode, new, sizeof *new,
+                             bucket_ofs (new_idx)) == sizeof *new
+             && inode_write_at (dir->inode, old, sizeof *old,
+                                bucket_ofs (old_idx)) == sizeof *old
+             && inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h);
+
+ done:
+  free (old);
+  free (new);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -60,6 +332,16 @@ dir_open_root (void)
   return dir_open (inode_open (ROOT_DIR_SECTOR));
 }
 
+/* Opens the running thread's working directory and returns a
+   directory for it.  Return true if successful, false on
+   failure. */
+struct dir *
+dir_open_cwd (void)
+{
+  struct inode *cwd = thread_current ()->cwd;
+  return cwd != NULL ? dir_open (inode_reopen (cwd)) : dir_open_root ();
+}
+
 /* Opens and returns a new directory for the same inode as DIR.
    Returns a null pointer on failure. */
 struct dir *
@@ -95,12 +377,37 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    {
+      struct dir_bucket *b = malloc (sizeof *b);
+      size_t bucket = hash_bucket (&h, hash_string (name));
+      bool found = false;
+      size_t i;
+
+      if (b != NULL
+          && inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (bucket))
+             == sizeof *b)
+        for (i = 0; i < BUCKET_ENTRIES; i++)
+          if (b->entries[i].in_use && !strcmp (name, b->entries[i].name))
+            {
+              if (ep != NULL)
+                *ep = b->entries[i];
+              if (ofsp != NULL)
+                *ofsp = bucket_ofs (bucket) + i * sizeof e;
+              found = true;
+              break;
+            }
+      free (b);
+      return found;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -114,6 +421,40 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Sets *OFSP to the offset of a free slot for NAME in the hashed
+   directory DIR, whose header is H, splitting buckets until one
+   is available.  Returns true if successful, false if the table
+   cannot grow. */
+static bool
+find_free_slot (struct dir *dir, struct dir_header *h, const char *name,
+                off_t *ofsp) 
+{
+  struct dir_bucket *b = malloc (sizeof *b);
+  unsigned hash = hash_string (name);
+  bool success = false;
+
+  while (b != NULL && h->level < MAX_LEVEL)
+    {
+      size_t bucket = hash_bucket (h, hash);
+      size_t i;
+
+      if (inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (bucket))
+          != sizeof *b)
+        break;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (!b->entries[i].in_use)
+          {
+            *ofsp = bucket_ofs (bucket) + i * sizeof (struct dir_entry);
+            success = true;
+            break;
+          }
+      if (success || !split_bucket (dir, h))
+        break;
+    }
+  free (b);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -122,15 +463,30 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector;
   struct dir_entry e;
+  struct dentry *d;
+  bool found;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+
+  lock_acquire (&dir_lock);
+  d = dentry_find (dir_sector, name);
+  if (d != NULL)
+    {
+      found = d->positive;
+      e.inode_sector = d->inode_sector;
+    }
   else
-    *inode = NULL;
+    {
+      found = lookup (dir, name, &e, NULL);
+      dentry_store (dir_sector, name, found, found ? e.inode_sector : 0);
+    }
+  *inode = found ? inode_open (e.inode_sector) : NULL;
+  lock_release (&dir_lock);
 
   return *inode != NULL;
 }
@@ -144,6 +500,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -155,29 +512,45 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  lock_acquire (&dir_lock);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  if (read_header (dir, &h))
+    {
+      /* Set OFS to a free slot in NAME's bucket. */
+      if (!find_free_slot (dir, &h, name, &ofs))
+        goto done;
+    }
+  else
+    {
+      /* Set OFS to offset of free slot.
+         If there are no free slots, then it will be set to the
+         current end-of-file.
      
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+         inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get a
+         short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0;
+           inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (!e.in_use)
+          break;
+    }
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    dentry_store (inode_get_inumber (dir->inode), name, true, inode_sector);
 
  done:
+  lock_release (&dir_lock);
   return success;
 }
 
@@ -195,6 +568,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  lock_acquire (&dir_lock);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -210,10 +585,13 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
   /* Remove inode. */
+  dentry_store (inode_get_inumber (dir->inode), name, false, 0);
+  dentry_purge (e.inode_sector);
   inode_remove (inode);
   success = true;
 
  done:
+  lock_release (&dir_lock);
   inode_close (inode);
   return success;
 }
@@ -224,16 +602,32 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool hashed;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  lock_acquire (&dir_lock);
+  hashed = read_header (dir, &h);
+  for (;;)
     {
+      /* Skip the header and the unused tail of each bucket. */
+      if (hashed && dir->pos < BLOCK_SECTOR_SIZE)
+        dir->pos = BLOCK_SECTOR_SIZE;
+      else if (hashed && (dir->pos % BLOCK_SECTOR_SIZE
+                          > BLOCK_SECTOR_SIZE - (off_t) sizeof e))
+        dir->pos = ROUND_UP (dir->pos, BLOCK_SECTOR_SIZE);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        break;
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  lock_release (&dir_lock);
+  return success;
 }
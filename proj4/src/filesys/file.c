@@ -148,6 +148,16 @@ file_length (struct file *file)
   return inode_length (file->inode);
 }
 
+/* Shrinks FILE to LENGTH bytes, freeing the sectors that held
+   the rest.  Does nothing if FILE is already no longer than
+   LENGTH.  The current position is not changed. */
+void
+file_truncate (struct file *file, off_t length) 
+{
+  ASSERT (file != NULL);
+  inode_truncate (file->inode, length);
+}
+
 /* Sets the current position in FILE to NEW_POS bytes from the
    start of the file. */
 void
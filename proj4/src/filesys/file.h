@@ -26,5 +26,6 @@ void file_allow_write (struct file *);
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
+void file_truncate (struct file *, off_t);
 
 #endif /* filesys/file.h */
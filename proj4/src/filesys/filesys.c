@@ -25,6 +25,7 @@ filesys_init (bool format)
   inode_init ();
   cache_init ();
   free_map_init ();
+  dir_init ();
 
   if (format) 
     do_format ();
@@ -49,7 +50,7 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
+  struct dir *dir = dir_open_cwd ();
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
                   && inode_create (inode_sector, initial_size)
@@ -69,7 +70,7 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir = dir_open_cwd ();
   struct inode *inode = NULL;
 
   if (dir != NULL)
@@ -86,7 +87,7 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir = dir_open_cwd ();
   bool success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
 
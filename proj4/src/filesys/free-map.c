@@ -1,13 +1,27 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects the variables below. */
+
+/* The free map is divided into groups of GROUP_SECTORS sectors,
+   with a count of free sectors kept for each, so that searches
+   can step over full groups without scanning their bits. */
+#define GROUP_SECTORS 256
+static size_t group_cnt;             /* Number of groups. */
+static size_t *group_free;           /* Free sectors in each group. */
+static size_t next_fit;              /* Where the next search starts. */
+
+static void count_groups (void);
 
 /* Initializes the free map. */
 void
@@ -16,9 +30,97 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("free map group counts allocation failed");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
   bitmap_mark (free_map, FREE_MAP_DATA); 
+  count_groups ();
+}
+
+/* Recomputes each group's free count from the bitmap. */
+static void
+count_groups (void) 
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++) 
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+/* Marks CNT sectors starting at SECTOR as in use if USED is
+   true, or free otherwise, keeping the group counts current.
+   The sectors must all currently be in the opposite state. */
+static void
+mark_sectors (block_sector_t sector, size_t cnt, bool used) 
+{
+  size_t end = sector + cnt;
+  size_t i;
+
+  bitmap_set_multiple (free_map, sector, cnt, used);
+  for (i = sector; i < end; i = (i / GROUP_SECTORS + 1) * GROUP_SECTORS) 
+    {
+      size_t group_end = (i / GROUP_SECTORS + 1) * GROUP_SECTORS;
+      size_t n = (group_end < end ? group_end : end) - i;
+      if (used)
+        group_free[i / GROUP_SECTORS] -= n;
+      else
+        group_free[i / GROUP_SECTORS] += n;
+    }
+}
+
+/* Returns the first sector at or after START, and before END,
+   that lies in a group with a free sector, or END if there is
+   none. */
+static size_t
+skip_full_groups (size_t start, size_t end) 
+{
+  size_t g;
+
+  for (g = start / GROUP_SECTORS; g * GROUP_SECTORS < end; g++)
+    if (group_free[g] > 0)
+      return g * GROUP_SECTORS > start ? g * GROUP_SECTORS : start;
+  return end;
+}
+
+/* Returns the first run of CNT free sectors that begins at or
+   after START and before END, or BITMAP_ERROR if there is none. */
+static size_t
+scan_range (size_t start, size_t end, size_t cnt) 
+{
+  size_t sector;
+
+  start = skip_full_groups (start, end);
+  if (start >= end)
+    return BITMAP_ERROR;
+  sector = bitmap_scan (free_map, start, cnt, false);
+  return sector < end ? sector : BITMAP_ERROR;
+}
+
+/* Finds CNT consecutive free sectors, searching next-fit from
+   where the last allocation ended and wrapping around to the
+   start of the device.  Returns the first sector, or
+   BITMAP_ERROR if there is no such run. */
+static size_t
+find_free (size_t cnt) 
+{
+  size_t sector;
+
+  if (next_fit >= bitmap_size (free_map))
+    next_fit = 0;
+  sector = scan_range (next_fit, bitmap_size (free_map), cnt);
+  if (sector == BITMAP_ERROR)
+    sector = scan_range (0, next_fit, cnt);
+  return sector;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -29,27 +131,93 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  lock_acquire (&free_map_lock);
+  block_sector_t sector = find_free (cnt);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark_sectors (sector, cnt, true);
+      if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+        {
+          mark_sectors (sector, cnt, false);
+          sector = BITMAP_ERROR;
+        }
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      next_fit = sector + cnt;
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
 
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates as many of the CNT sectors starting at SECTOR as are
+   free, stopping at the first one in use or past the end of the
+   device.  Returns the number of sectors allocated, which is 0 if
+   the free map file could not be written. */
+size_t
+free_map_extend (block_sector_t sector, size_t cnt)
+{
+  size_t got = 0;
+
+  lock_acquire (&free_map_lock);
+  while (got < cnt && sector + got < bitmap_size (free_map)
+         && !bitmap_test (free_map, sector + got))
+    got++;
+  if (got > 0)
+    {
+      mark_sectors (sector, got, true);
+      if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+        {
+          mark_sectors (sector, got, false);
+          got = 0;
+        }
+    }
+  lock_release (&free_map_lock);
+
+  return got;
+}
+
+/* Allocates the longest run of up to CNT consecutive sectors it
+   can find, halving the length it looks for until one fits, and
+   stores the first into *SECTORP.  Returns the number of sectors
+   allocated, or 0 if the disk is full. */
+size_t
+free_map_allocate_run (size_t cnt, block_sector_t *sectorp)
+{
+  for (; cnt > 0; cnt /= 2)
+    if (free_map_allocate (cnt, sectorp))
+      return cnt;
+  return 0;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
+  struct sector_run run;
+
+  run.start = sector;
+  run.length = cnt;
+  free_map_release_runs (&run, 1);
+}
+
+/* Makes the RUN_CNT runs of sectors in RUNS available for use,
+   writing the free map out once for all of them. */
+void
+free_map_release_runs (const struct sector_run *runs, size_t run_cnt)
+{
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < run_cnt; i++)
+    {
+      ASSERT (bitmap_all (free_map, runs[i].start, runs[i].length));
+      mark_sectors (runs[i].start, runs[i].length, false);
+    }
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -61,6 +229,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -5,6 +5,13 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* A run of LENGTH consecutive sectors starting at START. */
+struct sector_run
+  {
+    block_sector_t start;
+    size_t length;
+  };
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -12,6 +19,9 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_run (size_t, block_sector_t *);
+size_t free_map_extend (block_sector_t, size_t);
 void free_map_release (block_sector_t, size_t);
+void free_map_release_runs (const struct sector_run *, size_t);
 
 #endif /* filesys/free-map.h */
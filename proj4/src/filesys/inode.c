@@ -1,5 +1,5 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -14,15 +14,52 @@
 #define INODE_MAGIC 0x494e4f44
 #define INODE_OFS 4
 
+/* Number of sectors to read ahead of a sequential reader. */
+#define READ_AHEAD_SECTORS 8
+
+/* A run of LENGTH consecutive sectors starting at START. */
+struct extent
+  {
+    block_sector_t start;               /* First sector of the run. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+/* Number of extents in an inode. */
+#define EXTENT_CNT 54
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The first extent_sectors sectors of the file are described by
+   extents[], in file order.  Any sector past those is found
+   through the block pointers in sectors[]: 12 direct, then one
+   indirect and one doubly indirect block, indexed by file sector.
+   Once tree_used is set the extents are never grown again, so a
+   fragmented file just keeps using the pointers. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
-    block_sector_t sectors[126];               /* First data sector. */
+    block_sector_t sectors[14];         /* Block pointers. */
+    uint32_t extent_cnt;                /* Extents in use. */
+    uint32_t extent_sectors;            /* File sectors they cover. */
+    uint32_t tree_used;                 /* Nonzero once sectors[] is used. */
+    struct extent extents[EXTENT_CNT];  /* Contiguous runs. */
+    uint32_t unused;
     unsigned magic;                     /* Magic number. */
   };
 
+/* Byte offsets of fields within the on-disk inode. */
+#define EXTENT_HDR_OFS offsetof (struct inode_disk, extent_cnt)
+#define EXTENTS_OFS offsetof (struct inode_disk, extents)
+
+/* extent_cnt, extent_sectors and tree_used, read together. */
+struct extent_hdr
+  {
+    uint32_t cnt;
+    uint32_t sectors;
+    uint32_t tree_used;
+  };
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -34,17 +71,27 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 
 	/* Inode Content */
-	block_sector_t data_start;
 	off_t data_length;
 	struct lock ilock;
-	
+
+	/* Block map, decoded from the on-disk inode when it is opened
+	   and written through to it whenever it changes. */
+	struct lock map_lock;               /* Protects the fields below. */
+	struct extent_hdr hdr;              /* Extent header. */
+	struct extent extents[EXTENT_CNT];  /* Extents. */
+	block_sector_t sectors[14];         /* Block pointers. */
+
+	/* Read-ahead state */
+	off_t seq_pos;                      /* Where a sequential read resumes. */
+	size_t ra_sector;                   /* First sector not yet read ahead. */
+
   };
 
 static void
@@ -52,83 +99,411 @@ allocate_sector(block_sector_t * psector, block_sector_t parent, int ofs)
 {
   /* Get a new sector and write it in the parent block */
   static char zeros[BLOCK_SECTOR_SIZE];
-  free_map_allocate(1,psector);
+  if(!free_map_allocate(1,psector))
+  {
+	/* Disk full: leave the pointer unset */
+	*psector = 0;
+	return;
+  }
   cache_create(*psector,zeros);
   cache_write(parent,psector,ofs,4);
 }  
 
+/* Sets *PSECTOR to the block pointer at index IDX of INODE's
+   sectors[], allocating it if it is not set yet and CREATE is
+   true.  Returns false if it is not set. */
+static bool
+inode_pointer (struct inode *inode, int idx, block_sector_t *psector,
+               bool create)
+{
+  if(!inode->sectors[idx] && create)
+	allocate_sector(&inode->sectors[idx],inode->sector,INODE_OFS + 4 * idx);
+  *psector = inode->sectors[idx];
+  return *psector != 0;
+}
+
+/* Sets *PSECTOR to the pointer at byte OFS of index block
+   PARENT, allocating it if it is not set yet and CREATE is
+   true.  Returns false if it is not set. */
+static bool
+block_pointer (block_sector_t parent, int ofs, block_sector_t *psector,
+               bool create)
+{
+  cache_read(parent,psector,ofs,4);
+  if(!*psector && create)
+	allocate_sector(psector,parent,ofs);
+  return *psector != 0;
+}
+
+/* Returns the sector holding file sector VSECTOR of INODE through
+   its block pointers, allocating it and any missing index blocks
+   if CREATE is true.  Returns 0 for a hole if CREATE is false,
+   and if VSECTOR is past the largest file the pointers can map
+   or the disk is full.  The pointers in the inode itself come
+   from the decoded map, so only the indirect blocks are read. */
 static block_sector_t
-byte_to_psector (const struct inode *inode, off_t pos)
+tree_lookup (struct inode *inode, block_sector_t vsector, bool create)
 {
-  block_sector_t psector;
-  block_sector_t vsector = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t psector = 0;
 
   if(vsector < 12)
   {
 	/* Read the data sector directly from the inode */
-    int ofs = INODE_OFS + 4 * vsector;
-    cache_read(inode->sector,&psector,ofs,4);
-
-    if(!psector)
-    	allocate_sector(&psector,inode->sector,ofs);
+	inode_pointer(inode,vsector,&psector,create);
   }
   else if (vsector < 140)
   {
-	/* First get the iblock */
+	/* First get the iblock, then the data sector */
 	block_sector_t isector;
-	int iofs = 48 + INODE_OFS;
-	cache_read(inode->sector,&isector,iofs,4);
-	if(!isector)
-	  allocate_sector(&isector,inode->sector,iofs);
-
-	/* Then get the data sector */
 	vsector -= 12;
-	int ofs = 4 * vsector;
-	cache_read(isector,&psector,ofs,4);
-	if(!psector)
-	  allocate_sector(&psector,isector,ofs);
+	if(inode_pointer(inode,12,&isector,create))
+	  block_pointer(isector,4 * vsector,&psector,create);
   }
   else if (vsector < 16524)
   {
+	/* First get the double iblock, then the iblock, and finally
+	   the data sector */
+	block_sector_t double_isector, isector;
 	vsector -= 140;
-	/* First get the double iblock */
-	block_sector_t double_isector;
-	int double_ofs = 52 + INODE_OFS;
-	cache_read(inode->sector,&double_isector,double_ofs,4);
-	if(!double_isector)
-	  allocate_sector(&double_isector,inode->sector,double_ofs);
-
-	/* Then get the iblock */
-	block_sector_t isector;
-	int iofs = (vsector / 128) * 4;
-	cache_read(double_isector,&isector,iofs,4);
-	if(!isector)
-	  allocate_sector(&isector,double_isector,iofs);
-
-	/* Finally, read the data sector */
-    int ofs = (vsector % 128) * 4;
-	cache_read(isector,&psector,ofs,4);
-	if(!psector)
-	  allocate_sector(&psector,isector,ofs);
+	if(inode_pointer(inode,13,&double_isector,create)
+	   && block_pointer(double_isector,(vsector / 128) * 4,&isector,create))
+	  block_pointer(isector,(vsector % 128) * 4,&psector,create);
   }
+  return psector;
+}
+
+/* Returns the sector holding file sector VSECTOR of INODE if it
+   is covered by an extent, and stores in *RUN how many sectors
+   starting there are contiguous on disk.  Returns 0 otherwise. */
+static block_sector_t
+extent_lookup (const struct inode *inode, block_sector_t vsector,
+               size_t *run)
+{
+  block_sector_t first = 0;
+  uint32_t i;
+
+  if (vsector >= inode->hdr.sectors)
+    return 0;
+
+  for (i = 0; i < inode->hdr.cnt; i++)
+    {
+      const struct extent *e = &inode->extents[i];
+      if (vsector < first + e->length)
+        {
+          *run = first + e->length - vsector;
+          return e->start + (vsector - first);
+        }
+      first += e->length;
+    }
+  NOT_REACHED ();
+}
+
+/* Tries to allocate up to CNT file sectors of INODE starting at
+   VSECTOR as the next sectors of its extents.  The last extent
+   is grown as far as the free sectors after it allow, otherwise
+   a new extent is started with the longest free run that fits.
+   Stores the first new disk sector in *START and returns how many
+   sectors were allocated, all of them contiguous.  Returns 0 if
+   VSECTOR has to go in the block pointers instead.  The new
+   sectors are not zeroed. */
+static size_t
+extent_append_run (struct inode *inode, block_sector_t vsector, size_t cnt,
+                   block_sector_t *start)
+{
+  struct extent_hdr *hdr = &inode->hdr;
+  struct extent *last = NULL;
+  size_t got = 0;
+
+  if (hdr->tree_used || vsector != hdr->sectors)
+    return 0;
+
+  /* Grow the last extent over the free sectors after it. */
+  if (hdr->cnt > 0)
+    {
+      last = &inode->extents[hdr->cnt - 1];
+      got = free_map_extend (last->start + last->length, cnt);
+    }
+
+  if (got > 0)
+    {
+      *start = last->start + last->length;
+      last->length += got;
+    }
   else
-  {
-	printf("File too big!");
-	psector = -1;
-  }
- //printf("returning psector %d at vsector %d from sector %d\n",psector,vsector,inode->sector);
+    {
+      block_sector_t first;
+
+      if (hdr->cnt == EXTENT_CNT)
+        return 0;
+      got = free_map_allocate_run (cnt, &first);
+      if (got == 0)
+        return 0;
+      last = &inode->extents[hdr->cnt++];
+      last->start = *start = first;
+      last->length = got;
+    }
+  hdr->sectors += got;
+
+  cache_write (inode->sector, last,
+               EXTENTS_OFS + (last - inode->extents) * sizeof *last,
+               sizeof *last);
+  cache_write (inode->sector, hdr, EXTENT_HDR_OFS, sizeof *hdr);
+  return got;
+}
+
+/* Allocates file sector VSECTOR of INODE as the next sector of
+   its extents and zeroes it.  Returns the new sector, or 0 if
+   VSECTOR has to go in the block pointers instead. */
+static block_sector_t
+extent_append (struct inode *inode, block_sector_t vsector)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t psector;
+
+  if (extent_append_run (inode, vsector, 1, &psector) == 0)
+    return 0;
+  cache_create (psector, zeros);
+  return psector;
+}
+
+/* Does the work of byte_to_psector_run() for file sector
+   VSECTOR.  Must be called with INODE's map_lock held. */
+static block_sector_t
+vsector_to_psector (struct inode *inode, block_sector_t vsector,
+                    bool create, size_t *run)
+{
+  block_sector_t psector;
+
+  *run = 1;
+  psector = extent_lookup (inode, vsector, run);
+  if (psector == 0 && create)
+    psector = extent_append (inode, vsector);
+  if (psector == 0)
+    {
+      /* From now on the extents stay as they are. */
+      if (!inode->hdr.tree_used && create)
+        {
+          inode->hdr.tree_used = 1;
+          cache_write (inode->sector, &inode->hdr, EXTENT_HDR_OFS,
+                       sizeof inode->hdr);
+        }
+      psector = tree_lookup (inode, vsector, create);
+    }
+  return psector;
+}
+
+/* Returns the sector holding byte POS of INODE.  If it does not
+   exist yet, allocates it if CREATE is true, and otherwise
+   returns 0, since the file has a hole there.  If RUN is
+   nonnull, stores in *RUN how many sectors starting there are
+   known to be contiguous. */
+static block_sector_t
+byte_to_psector_run (struct inode *inode, off_t pos, bool create,
+                     size_t *run)
+{
+  block_sector_t psector;
+  size_t run_;
+
+  lock_acquire (&inode->map_lock);
+  psector = vsector_to_psector (inode, pos / BLOCK_SECTOR_SIZE, create,
+                                &run_);
+  lock_release (&inode->map_lock);
+
+  if (run != NULL)
+    *run = run_;
   return psector;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+static block_sector_t
+byte_to_psector (struct inode *inode, off_t pos, bool create)
+{
+  return byte_to_psector_run (inode, pos, create, NULL);
+}
+
+/* Sectors waiting to be freed, gathered into runs so that the
+   free map is updated once per batch rather than once per
+   sector. */
+#define RELEASE_RUNS 32
+struct release_batch
+  {
+    struct sector_run runs[RELEASE_RUNS];
+    size_t cnt;
+  };
+
+/* Frees every sector in batch B. */
+static void
+release_flush (struct release_batch *b)
+{
+  if (b->cnt > 0)
+    free_map_release_runs (b->runs, b->cnt);
+  b->cnt = 0;
+}
+
+/* Adds CNT sectors starting at SECTOR to batch B. */
+static void
+release_add (struct release_batch *b, block_sector_t sector, size_t cnt)
+{
+  struct sector_run *last = b->cnt > 0 ? &b->runs[b->cnt - 1] : NULL;
+
+  if (last != NULL && last->start + last->length == sector)
+    last->length += cnt;
+  else
+    {
+      if (b->cnt == RELEASE_RUNS)
+        release_flush (b);
+      b->runs[b->cnt].start = sector;
+      b->runs[b->cnt].length = cnt;
+      b->cnt++;
+    }
+}
+
+/* Frees the data sectors listed in the index block at SECTOR for
+   file sectors FIRST onward, where the block's first entry maps
+   file sector BASE, clearing their entries in IBLOCK, which holds
+   the block's contents.  Frees the index block itself too if
+   none of its entries are left, and returns true in that case. */
+static bool
+truncate_iblock (block_sector_t sector, block_sector_t *iblock,
+                 size_t base, size_t first, struct release_batch *b)
+{
+  size_t i = first > base ? first - base : 0;
+  bool changed = false;
+
+  cache_read (sector, iblock, 0, BLOCK_SECTOR_SIZE);
+  for (; i < 128; i++)
+    if (iblock[i])
+      {
+        release_add (b, iblock[i], 1);
+        iblock[i] = 0;
+        changed = true;
+      }
+
+  if (first <= base)
+    {
+      release_add (b, sector, 1);
+      return true;
+    }
+  if (changed)
+    cache_write (sector, iblock, 0, BLOCK_SECTOR_SIZE);
+  return false;
+}
+
+/* Frees every sector of INODE that holds file sectors
+   NEW_SECTORS onward, along with any index blocks left empty.
+   Each index block is read and written at most once, and the
+   free map is updated once per batch of runs.  Must be called
+   with INODE's map_lock held. */
+static void
+truncate_sectors (struct inode *inode, size_t new_sectors)
+{
+  struct extent_hdr *hdr = &inode->hdr;
+  struct release_batch b;
+  block_sector_t *iblock = NULL, *dblock = NULL;
+  size_t v;
+
+  b.cnt = 0;
+
+  /* Trim extents from the end. */
+  while (hdr->cnt > 0 && hdr->sectors > new_sectors)
+    {
+      struct extent *e = &inode->extents[hdr->cnt - 1];
+      size_t first = hdr->sectors - e->length;
+      size_t keep = new_sectors > first ? new_sectors - first : 0;
+
+      release_add (&b, e->start + keep, e->length - keep);
+      hdr->sectors -= e->length - keep;
+      e->length = keep;
+      if (keep > 0)
+        cache_write (inode->sector, e,
+                     EXTENTS_OFS + (hdr->cnt - 1) * sizeof *e, sizeof *e);
+      else
+        hdr->cnt--;
+    }
+  cache_write (inode->sector, hdr, EXTENT_HDR_OFS, sizeof *hdr);
+
+  /* Direct blocks. */
+  for (v = new_sectors; v < 12; v++)
+    if (inode->sectors[v])
+      {
+        release_add (&b, inode->sectors[v], 1);
+        inode->sectors[v] = 0;
+      }
+
+  if (inode->sectors[12] || inode->sectors[13])
+    {
+      iblock = malloc (BLOCK_SECTOR_SIZE);
+      dblock = malloc (BLOCK_SECTOR_SIZE);
+      if (iblock == NULL || dblock == NULL)
+        PANIC ("out of memory truncating inode %u", inode->sector);
+    }
+
+  /* Indirect block. */
+  if (inode->sectors[12]
+      && truncate_iblock (inode->sectors[12], iblock, 12, new_sectors, &b))
+    inode->sectors[12] = 0;
+
+  /* Doubly indirect block. */
+  if (inode->sectors[13])
+    {
+      bool changed = false;
+      size_t i;
+
+      cache_read (inode->sectors[13], dblock, 0, BLOCK_SECTOR_SIZE);
+      for (i = 0; i < 128; i++)
+        {
+          size_t base = 140 + i * 128;
+          if (dblock[i] && base + 128 > new_sectors
+              && truncate_iblock (dblock[i], iblock, base, new_sectors, &b))
+            {
+              dblock[i] = 0;
+              changed = true;
+            }
+        }
+      if (new_sectors <= 140)
+        {
+          release_add (&b, inode->sectors[13], 1);
+          inode->sectors[13] = 0;
+        }
+      else if (changed)
+        cache_write (inode->sectors[13], dblock, 0, BLOCK_SECTOR_SIZE);
+    }
+
+  cache_write (inode->sector, inode->sectors, INODE_OFS,
+               sizeof inode->sectors);
+  release_flush (&b);
+  free (iblock);
+  free (dblock);
+}
+
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects open_inodes and the open_cnt of each inode in it. */
+static struct lock open_inodes_lock;
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -174,35 +549,54 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+
+  /* Check whether this inode is already open.  If it is still
+     being read in, its map_lock is held until it is ready. */
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      lock_acquire (&inode->map_lock);
+      lock_release (&inode->map_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init(&inode->ilock);
-  cache_read (inode->sector,&inode->data_start,4,4);
+  lock_init(&inode->map_lock);
+  inode->seq_pos = 0;
+  inode->ra_sector = 0;
+  lock_acquire (&inode->map_lock);
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  /* Read the inode without holding up other opens. */
   cache_read (inode->sector,&inode->data_length,0,4);
+  cache_read (inode->sector,inode->sectors,INODE_OFS,sizeof inode->sectors);
+  cache_read (inode->sector,&inode->hdr,EXTENT_HDR_OFS,sizeof inode->hdr);
+  cache_read (inode->sector,inode->extents,EXTENTS_OFS,
+              inode->hdr.cnt * sizeof *inode->extents);
+  lock_release (&inode->map_lock);
   return inode;
 }
 
@@ -211,7 +605,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -228,28 +626,28 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          lock_acquire (&inode->map_lock);
+          truncate_sectors (inode, 0);
+          lock_release (&inode->map_lock);
           free_map_release (inode->sector, 1);
-		  int bytes = 1;
-		  block_sector_t psector;
-		  while(bytes < inode->data_length)
-		  {
-			psector = byte_to_psector(inode,bytes);
-			free_map_release(psector,1);
-			bytes += BLOCK_SECTOR_SIZE;
-		  }	
         }
 
       free (inode); 
@@ -265,6 +663,76 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Queues the sectors that follow a sequential read ending at
+   byte END of INODE for read-ahead.  Sectors already queued by an
+   earlier read are skipped. */
+static void
+read_ahead (struct inode *inode, off_t end)
+{
+  size_t sector = end / BLOCK_SECTOR_SIZE;
+  size_t limit = sector + READ_AHEAD_SECTORS;
+  size_t file_sectors = bytes_to_sectors (inode_length (inode));
+
+  if (limit > file_sectors)
+    limit = file_sectors;
+  if (sector < inode->ra_sector)
+    sector = inode->ra_sector;
+
+  for (; sector < limit; sector++)
+    {
+      block_sector_t psector
+        = byte_to_psector (inode, sector * BLOCK_SECTOR_SIZE, false);
+      if (psector != 0)
+        cache_read_ahead (psector);
+    }
+
+  if (limit > inode->ra_sector)
+    inode->ra_sector = limit;
+}
+
+/* Allocates the file sectors of INODE, which is growing from
+   OLD_SECTORS to NEW_SECTORS to hold a write of bytes [START,
+   END), in as few contiguous runs as the free map allows.  Only
+   sectors the write touches are allocated; any between the old
+   end of file and START are left as a hole that reads as zeros.
+   Sectors the write will cover entirely are not zeroed, since
+   their contents are about to be replaced. */
+static void
+inode_extend (struct inode *inode, size_t old_sectors, size_t new_sectors,
+              off_t start, off_t end)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t vsector = start / BLOCK_SECTOR_SIZE;
+
+  if (vsector < old_sectors)
+    vsector = old_sectors;
+
+  lock_acquire (&inode->map_lock);
+  while (vsector < new_sectors)
+    {
+      block_sector_t psector;
+      size_t got = extent_append_run (inode, vsector,
+                                      new_sectors - vsector, &psector);
+      if (got == 0)
+        {
+          /* The block pointers zero what they allocate. */
+          size_t run;
+          vsector_to_psector (inode, vsector, true, &run);
+          vsector++;
+          continue;
+        }
+
+      for (; got > 0; got--, vsector++, psector++)
+        {
+          off_t sector_start = (off_t) vsector * BLOCK_SECTOR_SIZE;
+          if (sector_start < start
+              || sector_start + BLOCK_SECTOR_SIZE > end)
+            cache_create (psector, zeros);
+        }
+    }
+  lock_release (&inode->map_lock);
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -280,11 +748,19 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 	return size;
   }
 
+  /* A read that starts where the last one ended is sequential,
+     anything else starts a new run */
+  bool sequential = offset == inode->seq_pos;
+  if (!sequential)
+    inode->ra_sector = offset / BLOCK_SECTOR_SIZE;
+
+  /* Current disk sector and how many more follow it contiguously */
+  block_sector_t sector_idx = 0;
+  size_t run_left = 0;
+
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_psector (inode, offset);
-	  //printf("reading from sector %d, from inode %d\n",sector_idx,inode->sector);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -297,22 +773,38 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-	  cache_read(sector_idx,buffer+bytes_read, sector_ofs, chunk_size);
+      /* Only look the sector up once the last run is used up */
+      if (run_left == 0)
+        sector_idx = byte_to_psector_run (inode, offset, false, &run_left);
+
+      /* A hole reads as zeros without allocating anything */
+      if (sector_idx == 0)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+	    cache_read(sector_idx,buffer+bytes_read, sector_ofs, chunk_size);
 
       /* Advance. */
+      sector_idx++;
+      run_left--;
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
 
+  inode->seq_pos = offset;
+  if (sequential && bytes_read > 0)
+    read_ahead (inode, offset);
+
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   A write past the end extends the file.  If it starts past the
+   end, the gap becomes a hole that takes no sectors and reads as
+   zeros.  Returns the number of bytes actually written, which
+   may be less than SIZE if the disk is full or OFFSET + SIZE is
+   past the largest file size.  The file then only grows as far
+   as the write got. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -329,30 +821,34 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	return size;
   }
 
+  /* A write past the end holds ilock until the data is in place,
+     so that readers never see the new length before the data. */
+  off_t length = offset + size;
   lock_acquire(&inode->ilock);
-  if(offset + size > inode_length(inode))
+  bool extending = length > inode_length(inode);
+  if(extending)
   {
-	
 	int old_sectors = bytes_to_sectors(inode->data_length);
-	int new_sectors = bytes_to_sectors(offset + size);
-	for(int i = old_sectors; i < new_sectors; i++)
-	{
-	  byte_to_psector(inode,i * BLOCK_SECTOR_SIZE +1);
-	}
-
-	inode->data_length = offset + size;
-	cache_write(inode->sector,&inode->data_length,0,4);
+	int new_sectors = bytes_to_sectors(length);
+	inode_extend(inode, old_sectors, new_sectors, offset, length);
+  }
+  else
+  {
+	length = inode_length(inode);
+    lock_release(&inode->ilock);
   }
-  lock_release(&inode->ilock);
+
+  /* Current disk sector and how many more follow it contiguously */
+  block_sector_t sector_idx = 0;
+  size_t run_left = 0;
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_psector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -361,18 +857,80 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      cache_write(sector_idx, buffer + bytes_written,
-			 		  sector_ofs,chunk_size);
+      /* Only look the sector up once the last run is used up */
+      if (run_left == 0)
+        sector_idx = byte_to_psector_run (inode, offset, true, &run_left);
+      if (sector_idx == 0)
+        break;
+
+      /* A whole sector is replaced without reading it first */
+      if (chunk_size == BLOCK_SECTOR_SIZE)
+        cache_create(sector_idx, (void *) (buffer + bytes_written));
+      else
+        cache_write(sector_idx, buffer + bytes_written,
+			 		    sector_ofs,chunk_size);
 
       /* Advance. */
+      sector_idx++;
+      run_left--;
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
 
+  if(extending)
+  {
+	if (bytes_written > 0 && offset > inode->data_length)
+	{
+	  inode->data_length = offset;
+	  cache_write(inode->sector,&inode->data_length,0,4);
+	}
+    lock_release(&inode->ilock);
+  }
+
   return bytes_written;
 }
 
+/* Shrinks INODE to LENGTH bytes, freeing the sectors past the
+   new end along with any index blocks left empty.  Does nothing
+   if INODE is already no longer than LENGTH. */
+void
+inode_truncate (struct inode *inode, off_t length)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  ASSERT (length >= 0);
+
+  lock_acquire (&inode->ilock);
+  if (length < inode->data_length)
+    {
+      int ofs = length % BLOCK_SECTOR_SIZE;
+
+      lock_acquire (&inode->map_lock);
+      truncate_sectors (inode, bytes_to_sectors (length));
+
+      /* Growing the file again must not bring back old bytes
+         from the part of the last sector that is cut off. */
+      if (ofs != 0)
+        {
+          block_sector_t psector;
+          size_t run;
+
+          psector = vsector_to_psector (inode, length / BLOCK_SECTOR_SIZE,
+                                        false, &run);
+          if (psector != 0)
+            cache_write (psector, zeros, ofs, BLOCK_SECTOR_SIZE - ofs);
+        }
+      lock_release (&inode->map_lock);
+
+      inode->data_length = length;
+      cache_write (inode->sector, &inode->data_length, 0, 4);
+      if (inode->seq_pos > length)
+        inode->seq_pos = length;
+    }
+  lock_release (&inode->ilock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
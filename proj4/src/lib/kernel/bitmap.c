@@ -288,6 +288,28 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Returns the index of the first bit in B at or after START,
+   and before END, that is set to VALUE, or END if there is
+   none.  Examines a whole element at a time. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      elem_type bits = value ? b->bits[idx] : ~b->bits[idx];
+
+      bits &= ~(elem_type) 0 << (start % ELEM_BITS);
+      if (bits != 0) 
+        {
+          size_t bit_idx = idx * ELEM_BITS + __builtin_ctzl (bits);
+          return bit_idx < end ? bit_idx : end;
+        }
+      start = (idx + 1) * ELEM_BITS;
+    }
+  return end;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,13 +320,26 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+      while (i <= last) 
+        {
+          /* Skip to the next candidate, then see how far the run
+             of VALUE bits starting there extends. */
+          size_t run_end;
+
+          i = next_bit (b, i, last + 1, value);
+          if (i > last)
+            break;
+          run_end = next_bit (b, i, i + cnt, !value);
+          if (run_end == i + cnt)
+            return i;
+          i = run_end + 1;
+        }
     }
   return BITMAP_ERROR;
 }
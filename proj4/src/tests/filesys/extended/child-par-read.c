@@ -0,0 +1,54 @@
+/* Child process for par-read.
+   Reads the file "data<n>" created by our parent several times
+   from start to end and verifies its contents each time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-par-read";
+
+static char expected[FILE_SIZE];
+static char actual[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int pass;
+  int fd;
+  int i;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  /* Regenerate the same bytes our parent wrote to our file. */
+  random_init (0);
+  for (i = 0; i <= child_idx; i++)
+    random_bytes (expected, sizeof expected);
+
+  snprintf (file_name, sizeof file_name, "data%d", child_idx);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < READ_PASSES; pass++) 
+    {
+      size_t ofs;
+
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE) 
+        {
+          CHECK (read (fd, actual, BLOCK_SIZE) == BLOCK_SIZE,
+                 "read %d bytes at offset %zu in \"%s\"",
+                 BLOCK_SIZE, ofs, file_name);
+          compare_bytes (actual, expected + ofs, BLOCK_SIZE, ofs, file_name);
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,51 @@
+/* Creates enough files in the root directory that its hash
+   buckets have to split several times, removes every other one,
+   and then checks that each name can or cannot be opened as
+   expected. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  msg ("creating %d files", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("removing odd-numbered files");
+  quiet = true;
+  for (i = 1; i < FILE_CNT; i += 2) 
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("checking files");
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      fd = open (name);
+      if (i % 2 == 0 && fd < 2)
+        fail ("open \"%s\" failed", name);
+      else if (i % 2 != 0 && fd >= 2)
+        fail ("open \"%s\" succeeded after remove", name);
+      if (fd >= 2)
+        close (fd);
+    }
+}
@@ -0,0 +1,44 @@
+/* Writes one byte 4 MB into an empty file, which is more than
+   the file system disk can hold, so it only works if the hole
+   before it is not allocated.  Then checks that the hole reads
+   back as zeros and removes the file. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  char byte = 'x';
+  char buf[512];
+  size_t i;
+  int fd;
+  
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("seek \"%s\"", file_name);
+  seek (fd, FILE_SIZE - 1);
+  CHECK (write (fd, &byte, 1) == 1, "write \"%s\"", file_name);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+
+  msg ("read hole in \"%s\"", file_name);
+  seek (fd, FILE_SIZE / 2);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read \"%s\" failed", file_name);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu of hole is %d, not 0", FILE_SIZE / 2 + i, buf[i]);
+
+  msg ("read end of \"%s\"", file_name);
+  seek (fd, FILE_SIZE - 1);
+  if (read (fd, buf, 1) != 1 || buf[0] != byte)
+    fail ("last byte of \"%s\" changed", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+}
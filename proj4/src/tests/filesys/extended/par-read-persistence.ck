@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my (%fs) = ("child-par-read" => "tests/filesys/extended/child-par-read");
+$fs{"data$_"} = [random_bytes (16 * 1024)] foreach 0...3;
+check_archive (\%fs);
+pass;
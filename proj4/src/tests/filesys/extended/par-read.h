@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_EXTENDED_PAR_READ_H
+#define TESTS_FILESYS_EXTENDED_PAR_READ_H
+
+#define CHILD_CNT 4
+#define FILE_SIZE (16 * 1024)
+#define BLOCK_SIZE 512
+#define READ_PASSES 4
+
+#endif /* tests/filesys/extended/par-read.h */
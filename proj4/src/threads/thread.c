@@ -12,6 +12,9 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
+#ifdef FILESYS
+#include "filesys/inode.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -99,8 +102,6 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
-  initial_thread->current_directory[0] = '/';
-  initial_thread->current_directory[1] = '\0';
 
 }
 
@@ -186,6 +187,9 @@ thread_create (const char *name, int priority,
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+#ifdef FILESYS
+  t->cwd = inode_reopen (thread_current ()->cwd);
+#endif
 
   /* If this is a process, set the parent */
   if(is_thread(running_thread()))
@@ -305,6 +309,9 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+#ifdef FILESYS
+  inode_close (thread_current ()->cwd);
+#endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -483,8 +490,6 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->is_process = false;
-  strlcpy(t->current_directory,running_thread()->current_directory,
-	      sizeof t->current_directory);
 
   /* Defaults to -1 in case anything goes wrong */
   t->exit_status = -1;
@@ -5,6 +5,8 @@
 #include <list.h>
 #include <stdint.h>
 
+struct inode;
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -101,7 +103,7 @@ struct thread
 	bool is_process;
 	int exit_status;
 	char process_name[16];
-	char current_directory[100];
+	struct inode *cwd;      /* Working directory, or null for the root. */
    	
 
 #ifdef USERPROG
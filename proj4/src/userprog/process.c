@@ -392,10 +392,9 @@ process_read(int fd, void *buffer, uint32_t size)
     if(!file)
       return -1;
 
-	 
-    lock_acquire(&file_lock);
+	/* The buffer cache and each inode's map_lock do their own
+	 * locking, so reads of different files do not take turns */
     bytes_read = file_read(file, buffer, size);
-    lock_release(&file_lock);
 	 
   }
 
@@ -420,11 +419,7 @@ process_write(int fd, void *buffer, uint32_t size)
 	if(!file)
 	  return 0;
 
-	lock_acquire(&file_lock);
-
 	bytes_written = file_write(file, buffer, size);
-
-	lock_release(&file_lock);
   }
 
   return bytes_written;